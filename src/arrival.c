@@ -0,0 +1,66 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "arrival.h"
+
+// Returns 0 and sets kind if the name is one of fixed, uniform, or poisson.
+int
+arrival_kind(const char *name, ArrivalKind *kind) {
+    if (0 == strcasecmp("fixed", name)) {
+	*kind = ARRIVAL_FIXED;
+    } else if (0 == strcasecmp("uniform", name)) {
+	*kind = ARRIVAL_UNIFORM;
+    } else if (0 == strcasecmp("poisson", name)) {
+	*kind = ARRIVAL_POISSON;
+    } else {
+	return EINVAL;
+    }
+    return 0;
+}
+
+// The seed is spread with a splitmix64 step so nearby seeds such as the base
+// seed plus the pool index give unrelated sequences.
+void
+arrival_init(Arrival a, ArrivalKind kind, uint64_t seed) {
+    uint64_t	z = seed + 0x9E3779B97F4A7C15ULL;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    a->kind = kind;
+    a->state = (0 == z) ? 1 : z;
+}
+
+// xorshift64* returning a value in [0.0, 1.0).
+static double
+next_unit(Arrival a) {
+    uint64_t	x = a->state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    a->state = x;
+
+    return (double)((x * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0; // 2^53
+}
+
+// Returns the gap until the next request in units where the mean gap is 1.0.
+// This is the number of requests worth of rate that must pass before the
+// next request is sent.
+double
+arrival_units(Arrival a) {
+    switch (a->kind) {
+    case ARRIVAL_UNIFORM:
+	return 2.0 * next_unit(a);
+    case ARRIVAL_POISSON:
+	// Exponentially distributed gaps give a Poisson arrival process.
+	return -log(1.0 - next_unit(a));
+    case ARRIVAL_FIXED:
+    default:
+	break;
+    }
+    return 1.0;
+}
@@ -0,0 +1,25 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#ifndef PERFER_ARRIVAL_H
+#define PERFER_ARRIVAL_H
+
+#include <stdint.h>
+
+typedef enum {
+    ARRIVAL_FIXED	= 0,
+    ARRIVAL_UNIFORM	= 1,
+    ARRIVAL_POISSON	= 2,
+} ArrivalKind;
+
+// Generates the gaps between metered requests. Each pool has its own so the
+// random number generator state is never shared between threads.
+typedef struct _arrival {
+    ArrivalKind	kind;
+    uint64_t	state;
+} *Arrival;
+
+extern int	arrival_kind(const char *name, ArrivalKind *kind);
+extern void	arrival_init(Arrival a, ArrivalKind kind, uint64_t seed);
+extern double	arrival_units(Arrival a);
+
+#endif /* PERFER_ARRIVAL_H */
@@ -0,0 +1,142 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#ifdef __linux__
+#define _GNU_SOURCE // for CPU affinity
+#endif
+
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "cpu.h"
+
+static double
+cpu_time(void) {
+    struct rusage	ru;
+
+    if (0 != getrusage(RUSAGE_SELF, &ru)) {
+	return 0.0;
+    }
+    return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+	(double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000000.0;
+}
+
+// Clock rate in Hz of the first CPU listed or 0 if not known.
+static double
+clock_rate(void) {
+    double	mhz = 0.0;
+#ifdef __linux__
+    FILE	*f = fopen("/proc/cpuinfo", "r");
+    char	line[256];
+
+    if (NULL == f) {
+	return 0.0;
+    }
+    while (NULL != fgets(line, sizeof(line), f)) {
+	if (0 == strncmp(line, "cpu MHz", 7)) {
+	    char	*colon = strchr(line, ':');
+
+	    if (NULL != colon && 1 == sscanf(colon + 1, "%lf", &mhz)) {
+		break;
+	    }
+	}
+    }
+    fclose(f);
+#endif
+    return mhz * 1000000.0;
+}
+
+// Must be called before the threads to be counted are started as the
+// counter is only inherited by new threads.
+void
+cpu_start(Cpu c) {
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+#ifdef __linux__
+    struct perf_event_attr	attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.disabled = 1;
+    if (0 <= (c->fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0))) {
+	ioctl(c->fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(c->fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    c->start = cpu_time();
+}
+
+void
+cpu_finish(Cpu c) {
+    c->secs = cpu_time() - c->start;
+    if (0 <= c->fd) {
+	uint64_t	cnt;
+
+	if (sizeof(cnt) == read(c->fd, &cnt, sizeof(cnt))) {
+	    c->cycles = (double)cnt;
+	}
+	close(c->fd);
+	c->fd = -1;
+	if (0.0 < c->cycles) {
+	    return;
+	}
+    }
+    c->cycles = c->secs * clock_rate();
+    c->estimated = true;
+}
+
+// Number of CPUs the system has, online or not.
+int
+cpu_count(void) {
+    long	cnt = sysconf(_SC_NPROCESSORS_CONF);
+
+    return (0 < cnt) ? (int)cnt : 1;
+}
+
+// Creates a thread that is pinned to a CPU unless cpu is negative and that
+// runs with the SCHED_FIFO policy if fifo is true. Returns 0 or an error code.
+int
+cpu_thread(pthread_t *t, void *(*fn)(void*), void *arg, int cpu, bool fifo) {
+    pthread_attr_t	attr;
+    int			err;
+
+    if (0 != (err = pthread_attr_init(&attr))) {
+	return err;
+    }
+#ifdef __linux__
+    if (0 <= cpu) {
+	cpu_set_t	set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (0 != (err = pthread_attr_setaffinity_np(&attr, sizeof(set), &set))) {
+	    goto DONE;
+	}
+    }
+#endif
+    if (fifo) {
+	struct sched_param	sp = { .sched_priority = sched_get_priority_min(SCHED_FIFO) };
+
+	if (0 != (err = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED)) ||
+	    0 != (err = pthread_attr_setschedpolicy(&attr, SCHED_FIFO)) ||
+	    0 != (err = pthread_attr_setschedparam(&attr, &sp))) {
+	    goto DONE;
+	}
+    }
+    err = pthread_create(t, &attr, fn, arg);
+DONE:
+    pthread_attr_destroy(&attr);
+
+    return err;
+}
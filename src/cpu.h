@@ -0,0 +1,29 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#ifndef PERFER_CPU_H
+#define PERFER_CPU_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_CPUS	1024
+
+// CPU used by the whole process over a run. Cycles come from a hardware
+// counter when one can be opened and are otherwise estimated from the CPU
+// time and the clock rate.
+typedef struct _cpu {
+    int		fd;        // cycle counter or -1
+    double	start;     // CPU seconds at the start
+    double	secs;      // CPU seconds used once finished
+    double	cycles;    // cycles used once finished
+    bool	estimated; // cycles are from the CPU time and clock rate
+} *Cpu;
+
+extern void	cpu_start(Cpu c);
+extern void	cpu_finish(Cpu c);
+
+extern int	cpu_count(void);
+extern int	cpu_thread(pthread_t *t, void *(*fn)(void*), void *arg, int cpu, bool fifo);
+
+#endif /* PERFER_CPU_H */
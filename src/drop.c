@@ -17,38 +17,103 @@
 #include "pool.h"
 #include "stagger.h"
 
-static const char	content_length[] = "Content-Length:";
-static const char	transfer_encoding[] = "Transfer-Encoding:";
-
 void
-drop_init(Drop d, struct _pool *pool) {
+drop_init(Drop d, struct _pool *pool, atime *pipeline, int psize) {
     memset(d, 0, sizeof(struct _drop));
     d->pool = pool;
-    d->perfer = pool->perfer;
+    d->pipeline = pipeline;
+    d->psize = psize;
     atomic_init(&d->recv_time, 0);
+    resp_reset(&d->resp);
 
-    atime	*end = d->pipeline + sizeof(d->pipeline) / sizeof(*d->pipeline);
+    atime	*end = d->pipeline + psize;
 
     for (atime *tp = d->pipeline; tp < end; tp++) {
 	atomic_init(tp, 0);
     }
     atomic_init(&d->phead, 0);
     atomic_init(&d->ptail, 0);
+    atomic_init(&d->closing, false);
 }
 
-void
-drop_cleanup(Drop d) {
+// Resets what the polling thread writes and closes the socket.
+static void
+send_reset(Drop d) {
+#ifdef HAVE_URING
+    if (d->armed) {
+	// Completes the multishot receive still holding the socket.
+	shutdown(d->sock, SHUT_RDWR);
+	d->armed = false;
+    }
+    d->gen++; // completions for the old socket are ignored
+#endif
+    if (d->connecting) {
+	d->connecting = false;
+	d->pool->con_active--;
+    }
+    if (0 < d->unsent) {
+	// Requests waiting on the connect or socket buffer will never be sent.
+	int	tail = atomic_load(&d->ptail) - d->unsent;
+
+	if (tail < 0) {
+	    tail += d->psize;
+	}
+	atomic_store(&d->ptail, tail);
+	atomic_fetch_sub(&d->pool->inflight, d->unsent);
+	tally_add(&d->pool->poll_tally.err_cnt, d->unsent);
+	d->unsent = 0;
+    }
+    d->woff = 0;
+    d->blocked_at = 0;
+    d->wsock = 0;
+    d->wevents = 0;
     if (0 != d->sock) {
 	close(d->sock);
     }
     d->sock = 0;
-    d->pp = NULL;
 #ifdef WITH_OPENSSL
     d->bio = NULL;
 #endif
+}
+
+// Resets what the receiving thread writes.
+static void
+recv_reset(Drop d) {
     d->rcnt = 0;
     d->xsize = 0;
-    *d->buf = '\0';
+    resp_reset(&d->resp);
+    // The buffer, if any, is left for the receiving thread to give back.
+}
+
+// Closes the connection and resets it. Called by the polling thread or, before
+// the run starts, the main thread.
+void
+drop_cleanup(Drop d) {
+    send_reset(d);
+    recv_reset(d);
+    pool_wake(d->pool, d); // ready to connect again
+}
+
+// Closes the connection from the receiving side. Only the receiving half of
+// the state is reset here. The socket is shut down so nothing more is sent or
+// read and the polling thread finishes the job with drop_closed(). When the
+// polling thread also receives it is all done at once.
+void
+drop_close(Drop d) {
+    if (d->pool->perfer->inline_recv) {
+	drop_cleanup(d);
+	return;
+    }
+    recv_reset(d);
+    pool_close(d->pool, d);
+}
+
+// Finishes a close started by the receiving thread. Polling thread only.
+void
+drop_closed(Drop d) {
+    send_reset(d);
+    atomic_store(&d->closing, false);
+    pool_wake(d->pool, d); // ready to connect again
 }
 
 int
@@ -56,17 +121,22 @@ drop_pending(Drop d) {
     int	len = atomic_load(&d->ptail) - atomic_load(&d->phead);
 
     if (len < 0) {
-	len += PIPELINE_SIZE;
+	len += d->psize;
     }
     return len;
 }
 
+// The connect does not block. If it is still in progress when this returns
+// the drop is marked as connecting and drop_connected() should be called once
+// the socket is writable.
 static int
 drop_connect_normal(Drop d) {
-    int	optval = 1;
-    int	flags;
+    Perfer		pr = d->pool->perfer;
+    struct addrinfo	*ai = pr->addr_info;
+    int			optval = 1;
+    int			flags;
 
-    if (0 > (d->sock = socket(d->perfer->addr_info->ai_family, d->perfer->addr_info->ai_socktype, d->perfer->addr_info->ai_protocol))) {
+    if (0 > (d->sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol))) {
 	if (EINPROGRESS != errno) {
 	    printf("*-*-* error opening socket: %s\n", strerror(errno));
 	    goto FAIL;
@@ -76,17 +146,25 @@ drop_connect_normal(Drop d) {
 	printf("*-*-* error setting socket option: %s\n", strerror(errno));
 	goto FAIL;
     }
-    if (0 > connect(d->sock, d->perfer->addr_info->ai_addr, d->perfer->addr_info->ai_addrlen)) {
-	printf("*-*-* error connecting: %s\n", strerror(errno));
+    if (0 < pr->notsent_lowat &&
+	0 > setsockopt(d->sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &pr->notsent_lowat, sizeof(pr->notsent_lowat))) {
+	printf("*-*-* error setting socket option: %s\n", strerror(errno));
 	goto FAIL;
     }
     flags = fcntl(d->sock, F_GETFL, 0);
     fcntl(d->sock, F_SETFL, O_NONBLOCK | flags);
     d->rcnt = 0;
-
+    d->con_start = ntime();
+    if (0 > connect(d->sock, ai->ai_addr, ai->ai_addrlen)) {
+	if (EINPROGRESS != errno) {
+	    printf("*-*-* error connecting: %s\n", strerror(errno));
+	    goto FAIL;
+	}
+	d->connecting = true;
+	d->pool->con_active++;
+    }
     return 0;
 FAIL:
-    atomic_fetch_add(&d->perfer->err_cnt, 1);
     d->finished = true;
     d->end_time = ntime();
     return errno;
@@ -105,142 +183,310 @@ int
 drop_connect(Drop d) {
     int	err;
 
-    if (d->perfer->tls) {
+    if (d->pool->perfer->tls) {
 	err = drop_connect_tls(d);
     } else {
 	err = drop_connect_normal(d);
     }
-    if (0 == err) {
-	atomic_fetch_add(&d->perfer->con_cnt, 1);
-    } else {
-	atomic_fetch_add(&d->perfer->err_cnt, 1);
+    if (0 != err) {
+	tally_add(&d->pool->poll_tally.err_cnt, 1);
+    } else if (!d->connecting) {
+	stagger_add(&d->pool->con_lat, ntime() - d->con_start);
+	tally_add(&d->pool->poll_tally.con_cnt, 1);
     }
     return err;
 }
 
+// Finishes a connect that was in progress once the socket is writable or has
+// an error. Returns 0 if connected.
 int
-drop_recv(Drop d) {
-    if (0 >= drop_pending(d)) {
-	return 0;
-    }
-    Perfer	pr = d->perfer;
+drop_connected(Drop d) {
     Pool	p = d->pool;
-    ssize_t	rcnt;
+    int		err = 0;
+    socklen_t	len = sizeof(err);
 
-    if (0 == d->sock) {
-	return 0;
+    if (0 > getsockopt(d->sock, SOL_SOCKET, SO_ERROR, &err, &len)) {
+	err = errno;
     }
-    if (0 > (rcnt = recv(d->sock, d->buf + d->rcnt, sizeof(d->buf) - d->rcnt - 1, 0))) {
-	if (EAGAIN != errno) {
-	    drop_cleanup(d);
-	    atomic_fetch_add(&d->perfer->err_cnt, 1);
+    d->connecting = false;
+    p->con_active--;
+    if (0 != err) {
+	if (!d->pool->perfer->json) {
+	    printf("*-*-* error connecting: %s\n", strerror(err));
 	}
-	//printf("*-*-* error reading response on %d: %s\n", d->sock, strerror(errno));
-	return errno;
+	tally_add(&p->poll_tally.err_cnt, 1);
+	drop_cleanup(d);
+	return err;
     }
-    if (0 == rcnt) {
-	return 0;
+    stagger_add(&p->con_lat, ntime() - d->con_start);
+    tally_add(&p->poll_tally.con_cnt, 1);
+
+    return 0;
+}
+
+// A buffer is taken from the pool only while bytes of a response are waiting
+// to be parsed so idle connections do not hold one.
+static bool
+buf_attach(Drop d) {
+    if (NULL == d->buf && NULL == (d->buf = pool_buf_take(d->pool))) {
+	if (!d->pool->perfer->json) {
+	    printf("*-*-* Not enough memory for a receive buffer.\n");
+	}
+	drop_close(d);
+	tally_add(&d->pool->recv_tally.err_cnt, 1);
+	return false;
+    }
+    return true;
+}
+
+static void
+buf_detach(Drop d) {
+    if (NULL != d->buf && 0 == d->rcnt) {
+	pool_buf_give(d->pool, d->buf);
+	d->buf = NULL;
+    }
+}
+
+static int
+parse_error(Drop d, const char *what) {
+    if (!d->pool->perfer->json) {
+	printf("*-*-* %s on %d.\n", what, d->sock);
+    }
+    drop_close(d);
+    tally_add(&d->pool->recv_tally.err_cnt, 1);
+
+    return EIO;
+}
+
+// Records the latency of a complete response and gets ready for the next
+// one. Returns true if the connection was closed.
+static bool
+finish(Drop d, int64_t recv_time) {
+    Perfer	pr = d->pool->perfer;
+    Pool	p = d->pool;
+    int		head = atomic_load(&d->phead);
+    int64_t	current = atomic_load(&d->pipeline[head]);
+    int64_t	dt = recv_time - current;
+
+    tally_add(&p->recv_tally.byte_cnt, d->xsize);
+    if (0 < current) {
+	if (dt < 0) {
+	    // The poll thread stamped a readable event left over from the
+	    // previous response before this request was sent so the time of
+	    // the read is the best available.
+	    recv_time = ntime();
+	    dt = recv_time - current;
+	}
+	stagger_add(p->cur_lat, dt);
+    } else {
+	tally_add(&p->recv_tally.err_cnt, 1);
+    }
+    d->end_time = recv_time;
+
+    head++;
+    if (d->psize <= head) {
+	head = 0;
+    }
+    atomic_store(&d->phead, head);
+    atomic_fetch_sub(&p->inflight, 1);
+    pool_wake(p, d);
+    if ((pr->enough || !pr->keep_alive) && 0 >= drop_pending(d) ) {
+	drop_close(d);
+	return true;
     }
-    d->rcnt += rcnt;
+    resp_reset(&d->resp);
+    d->xsize = 0;
+
+    return false;
+}
 
-    int64_t	recv_time = atomic_load(&d->recv_time);
+// Works through the responses in the buffer, recording the latency of each
+// one that is complete. Once the headers of a response are parsed its body
+// bytes are counted and dropped as they arrive so nothing is left in the
+// buffer and only the parser state carries over between reads. Only headers
+// cut off by the end of a read wait in the buffer for the rest.
+static int
+consume(Drop d, int64_t recv_time) {
+    Pool	p = d->pool;
 
     while (0 < d->rcnt) {
-	if (0 >= d->xsize) {
-	    if (0 < p->xsize && 0 == memcmp(p->xbuf, d->buf, p->xsize)) {
-		d->xsize = p->xsize;
+	long	used = 0;
+
+	if (0 == d->resp.hsize) {
+	    // Most responses are the same as the one seen in the warmup so a
+	    // compare is enough unless the response is split across reads.
+	    if (0 == d->resp.off && 0 < p->xsize && p->xsize <= d->rcnt && 0 == memcmp(p->xbuf, d->buf, p->xsize)) {
+		used = p->xsize;
+		d->resp.done = true;
 	    } else {
-		char	*cl = strstr(d->buf, content_length);
-		char	*hend;
+		long	size = resp_parse(&d->resp, d->buf, d->rcnt);
 
-		if (NULL == cl) {
-		    hend = strstr(d->buf, "\r\n\r\n");
-		} else {
-		    hend = strstr(cl, "\r\n\r\n");
+		if (0 > size) {
+		    return parse_error(d, "error parsing response");
 		}
-		if (NULL == hend) {
-		    return 0;
-		}
-		if (NULL == cl) {
-		    char	*te = strstr(d->buf, transfer_encoding);
-
-		    // TBD Handle chunking correctly. This approach only works
-		    // when all the chunks come in one read and no more than that.
-		    if (NULL != te && 0 == strncasecmp("chunked\r", te + sizeof(transfer_encoding), 8)) {
-			d->xsize = d->rcnt;
-		    } else {
-			d->xsize = hend - d->buf + 4;
-		    }
-		} else {
-		    cl += sizeof(content_length);
-		    for (; ' ' == *cl; cl++) {
+		if (0 == size) {
+		    if (p->bsize - 1 <= d->rcnt) {
+			return parse_error(d, "response headers too large");
 		    }
-		    char	*end;
-		    long	len = strtol(cl, &end, 10);
-
-		    if ('\r' != *end) {
-			if (!d->perfer->json) {
-			    printf("*-*-* error reading content length on %d.\n", d->sock);
-			}
-			drop_cleanup(d);
-			atomic_fetch_add(&pr->err_cnt, 1);
-			return EIO;
-		    }
-		    d->xsize = hend - d->buf + 4 + len;
-		}
-		if (0 >= d->xsize) {
-		    break;
+		    return 0;
 		}
+		used = d->resp.hsize;
 	    }
 	}
-	if (d->xsize <= d->rcnt) {
-	    int		head = atomic_load(&d->phead);
-	    int64_t	current = atomic_load(&d->pipeline[head]);
-	    int64_t	dt = recv_time - current;
-
-	    atomic_fetch_add(&pr->byte_cnt, d->xsize);
-	    if (0 < current) {
-		if (dt < 0) {
-		    dt = 0;
-		}
-		stagger_add(dt);
-	    } else {
-		atomic_fetch_add(&pr->err_cnt, 1);
+	if (!d->resp.done) {
+	    long	cnt = resp_body(&d->resp, d->buf + used, d->rcnt - used);
+
+	    if (0 > cnt) {
+		return parse_error(d, "error parsing response body");
+	    }
+	    used += cnt;
+	}
+	d->xsize += used;
+	if (!d->resp.done) {
+	    // All that was read is part of this response and has been counted.
+	    d->rcnt = 0;
+	    break;
+	}
+	if (finish(d, recv_time)) {
+	    return 0;
+	}
+	if (used < d->rcnt) {
+	    memmove(d->buf, d->buf + used, d->rcnt - used);
+	    d->rcnt -= used;
+	} else {
+	    d->rcnt = 0;
+	}
+    }
+    return 0;
+}
+
+int
+drop_recv(Drop d) {
+    if (0 >= drop_pending(d)) {
+	return 0;
+    }
+    Pool	p = d->pool;
+    ssize_t	rcnt;
+
+    if (0 == d->sock || atomic_load(&d->closing)) {
+	return 0;
+    }
+#ifdef __linux__
+    long	left;
+
+    if (d->pool->perfer->discard && 0 == d->rcnt && 0 < (left = resp_skippable(&d->resp))) {
+	// With MSG_TRUNC the kernel drops the body bytes without copying
+	// them so no buffer is needed.
+	if (0 > (rcnt = recv(d->sock, NULL, left, MSG_TRUNC))) {
+	    if (EAGAIN != errno) {
+		drop_close(d);
+		tally_add(&p->recv_tally.err_cnt, 1);
+	    }
+	    return errno;
+	}
+	if (0 < rcnt) {
+	    d->xsize += resp_skip(&d->resp, rcnt);
+	    if (d->resp.done) {
+		finish(d, atomic_load(&d->recv_time));
 	    }
-	    d->end_time = recv_time;
+	}
+	return 0;
+    }
+#endif
+    int		err = 0;
+
+    if (!buf_attach(d)) {
+	return ENOMEM;
+    }
+    if (0 > (rcnt = recv(d->sock, d->buf + d->rcnt, p->bsize - d->rcnt - 1, 0))) {
+	err = errno;
+	if (EAGAIN != err) {
+	    drop_close(d);
+	    tally_add(&p->recv_tally.err_cnt, 1);
+	}
+	//printf("*-*-* error reading response on %d: %s\n", d->sock, strerror(errno));
+    } else if (0 < rcnt) {
+	d->rcnt += rcnt;
+	err = consume(d, atomic_load(&d->recv_time));
+    }
+    buf_detach(d);
+
+    return err;
+}
+
+// Takes data that was read by some other means, such as an io_uring provided
+// buffer, and processes it as if it had been read into the drop buffer.
+int
+drop_received(Drop d, const char *data, long len, int64_t recv_time) {
+    int	err;
+
+    while (0 < len && 0 != d->sock) {
+	long	cnt;
 
-	    head++;
-	    if (PIPELINE_SIZE <= head) {
-		head = 0;
+	if (0 == d->rcnt && 0 < d->resp.hsize && !d->resp.done) {
+	    // Body bytes are framed where they are instead of being copied.
+	    if (0 > (cnt = resp_body(&d->resp, data, len))) {
+		return parse_error(d, "error parsing response body");
 	    }
-	    atomic_store(&d->phead, head);
-	    if ((pr->enough || !pr->keep_alive) && 0 >= drop_pending(d) ) {
-		drop_cleanup(d);
-		return 0;
-	    } else {
-		if (d->xsize < d->rcnt) {
-		    memmove(d->buf, d->buf + d->xsize, d->rcnt - d->xsize);
-		    d->rcnt -= d->xsize;
-		    d->xsize = 0;
-		} else {
-		    d->rcnt = 0;
-		    d->xsize = 0;
-		    break;
-		}
+	    d->xsize += cnt;
+	    data += cnt;
+	    len -= cnt;
+	    if (d->resp.done) {
+		finish(d, recv_time);
 	    }
-	} else {
-	    break;
+	    continue;
+	}
+	if (!buf_attach(d)) {
+	    return ENOMEM;
+	}
+	cnt = d->pool->bsize - d->rcnt - 1;
+
+	if (len < cnt) {
+	    cnt = len;
+	}
+	if (0 >= cnt) {
+	    // Only headers larger than the buffer get here.
+	    drop_close(d);
+	    tally_add(&d->pool->recv_tally.err_cnt, 1);
+	    buf_detach(d);
+	    return EIO;
+	}
+	memcpy(d->buf + d->rcnt, data, cnt);
+	d->rcnt += cnt;
+	data += cnt;
+	len -= cnt;
+	err = consume(d, recv_time);
+	buf_detach(d);
+	if (0 != err) {
+	    return err;
 	}
     }
     return 0;
 }
 
+// The socket does not block so a large request is written as the socket
+// buffer drains.
 int
 drop_warmup_send(Drop d) {
-    if (d->perfer->req_len != send(d->sock, d->perfer->req_body, d->perfer->req_len, 0)) {
-	printf("*-*-* error sending request: %s\n", strerror(errno));
-	drop_cleanup(d);
-	return errno;
+    const char	*body = d->pool->perfer->req_body;
+    long	len = d->pool->perfer->req_len;
+    ssize_t	scnt;
+    double	giveup = dtime() + 2.0;
+
+    while (0 < len) {
+	if (0 > (scnt = send(d->sock, body, len, 0))) {
+	    if (EAGAIN != errno || giveup < dtime()) {
+		printf("*-*-* error sending request: %s\n", strerror(errno));
+		drop_cleanup(d);
+		return errno;
+	    }
+	    struct pollfd	pf = { .fd = d->sock, .events = POLLOUT, .revents = 0 };
+
+	    poll(&pf, 1, 10);
+	    continue;
+	}
+	body += scnt;
+	len -= scnt;
     }
     return 0;
 }
@@ -248,10 +494,16 @@ drop_warmup_send(Drop d) {
 int
 drop_warmup_recv(Drop d) {
     ssize_t	rcnt;
-    long	hsize = 0;
+    long	size;
+    long	start = 0; // body bytes before start have been framed
+    bool	whole = true; // the whole response is in the buffer
     double	giveup = dtime() + 2.0;
-    Perfer	p = d->perfer;
+    Perfer	p = d->pool->perfer;
 
+    // The buffer is left attached for pool_warmup() to copy from.
+    if (!buf_attach(d)) {
+	return ENOMEM;
+    }
     while (true) {
 	if (giveup < dtime()) {
 	    if (!p->json) {
@@ -259,7 +511,7 @@ drop_warmup_recv(Drop d) {
 	    }
 	    return -1;
 	}
-	if (0 > (rcnt = recv(d->sock, d->buf + d->rcnt, sizeof(d->buf) - d->rcnt - 1, 0))) {
+	if (0 > (rcnt = recv(d->sock, d->buf + d->rcnt, d->pool->bsize - d->rcnt - 1, 0))) {
 	    if (EAGAIN != errno) {
 		if (!p->json) {
 		    printf("*-*-* error reading response on %d: %s\n", d->sock, strerror(errno));
@@ -270,69 +522,78 @@ drop_warmup_recv(Drop d) {
 	    dsleep(0.001);
 	    continue;
 	}
+	if (0 == rcnt) {
+	    if (!p->json) {
+		printf("*-*-* connection closed before a response on %d\n", d->sock);
+	    }
+	    drop_cleanup(d);
+	    return EIO;
+	}
 	d->rcnt += rcnt;
-	if (0 < d->rcnt) {
-	    if (0 >= d->xsize) {
-		char	*cl = strstr(d->buf, content_length);
-		char	*hend;
-
-		if (NULL == cl) {
-		    hend = strstr(d->buf, "\r\n\r\n");
-		} else {
-		    hend = strstr(cl, "\r\n\r\n");
-		}
-		if (NULL == hend) {
-		    return 0;
+	if (0 == d->resp.hsize) {
+	    if (0 > (size = resp_parse(&d->resp, d->buf, d->rcnt))) {
+		if (!p->json) {
+		    printf("*-*-* error parsing response on %d.\n", d->sock);
 		}
-		if (NULL == cl) {
-		    char	*te = strstr(d->buf, transfer_encoding);
-
-		    // TBD Handle chunking correctly. This approach only works
-		    // when all the chunks come in one read and no more than that.
-		    if (NULL != te && 0 == strncasecmp("chunked\r", te + sizeof(transfer_encoding), 8)) {
-			d->xsize = d->rcnt;
-		    } else {
-			d->xsize = hend - d->buf + 4;
-		    }
-		} else {
-		    cl += sizeof(content_length);
-		    for (; ' ' == *cl; cl++) {
-		    }
-		    char	*end;
-		    long	len = strtol(cl, &end, 10);
-
-		    if ('\r' != *end) {
-			if (!p->json) {
-			    printf("*-*-* error reading content length on %d.\n", d->sock);
-			}
-			drop_cleanup(d);
-			atomic_fetch_add(&p->err_cnt, 1);
-			return EIO;
+		drop_cleanup(d);
+		tally_add(&d->pool->poll_tally.err_cnt, 1);
+		return EIO;
+	    }
+	    if (0 == size) {
+		if (d->pool->bsize - 1 <= d->rcnt) {
+		    if (!p->json) {
+			printf("*-*-* response headers too large on %d.\n", d->sock);
 		    }
-		    d->xsize = hend - d->buf + 4 + len;
+		    drop_cleanup(d);
+		    tally_add(&d->pool->poll_tally.err_cnt, 1);
+		    return EIO;
 		}
-		if (0 >= d->xsize) {
-		    break;
-		}
-		hsize = hend - d->buf;
+		continue;
 	    }
-	    if (d->xsize <= d->rcnt) {
-		if (p->verbose) {
-		    char	save = d->buf[d->xsize];
-
-		    d->buf[d->xsize] = '\0';
-		    pthread_mutex_lock(&p->print_mutex);
-		    printf("\nsize: %ld body: %ld --------------------------------------------------------------------------------\n%s\n",
-			   d->xsize, d->xsize - hsize, d->buf);
-		    pthread_mutex_unlock(&p->print_mutex);
-		    d->buf[d->xsize] = save;
+	    start = d->resp.hsize;
+	    d->xsize = start;
+	}
+	if (!d->resp.done) {
+	    if (0 > (size = resp_body(&d->resp, d->buf + start, d->rcnt - start))) {
+		if (!p->json) {
+		    printf("*-*-* error parsing response body on %d.\n", d->sock);
 		}
-		d->rcnt = 0;
-		break;
+		drop_cleanup(d);
+		tally_add(&d->pool->poll_tally.err_cnt, 1);
+		return EIO;
 	    }
+	    start += size;
+	    d->xsize += size;
+	}
+	if (d->resp.done) {
+	    break;
+	}
+	if (d->pool->bsize - 1 <= d->rcnt) {
+	    // The body is too large to keep so only the headers are held on to
+	    // if they leave room to read more.
+	    whole = false;
+	    d->rcnt = (d->resp.hsize < d->pool->bsize / 2) ? d->resp.hsize : 0;
+	    start = d->rcnt;
 	}
     }
+    if (p->verbose) {
+	pthread_mutex_lock(&p->print_mutex);
+	printf("\nsize: %ld body: %ld --------------------------------------------------------------------------------\n",
+	       d->xsize, d->xsize - d->resp.hsize);
+	if (whole) {
+	    d->buf[d->xsize] = '\0';
+	    printf("%s\n", d->buf);
+	} else if (0 < d->rcnt) {
+	    printf("%.*s[body not shown]\n", (int)d->resp.hsize, d->buf);
+	}
+	pthread_mutex_unlock(&p->print_mutex);
+    }
+    if (!whole) {
+	// Too large to compare against so flag it as such.
+	d->xsize = -1;
+    }
     d->rcnt = 0;
+    resp_reset(&d->resp);
     // d->xsize = 0; set outside so the xsize can be grabbed and compared
 
     return 0;
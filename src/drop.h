@@ -5,52 +5,88 @@
 
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <poll.h>
+
+#include "resp.h"
 #ifdef WITH_OPENSSL
 #include <openssl/bio.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #endif
 
+// The largest receive buffer. Buffers are shared by the connections in a pool
+// and sized from the warmup responses.
 //#define MAX_RESP_SIZE	4096
 #define MAX_RESP_SIZE	16384
 //#define MAX_RESP_SIZE	64000
-#define PIPELINE_SIZE	16
+#define CACHE_LINE	64
+// The most requests that can be outstanding on a connection.
+#define MAX_BACKLOG	4096
 
 typedef atomic_int_fast64_t	atime;
 
-struct _perfer;
 struct _pool;
 
+// Fields are grouped by the thread that writes them with each group starting
+// on its own cache line so the polling and receiving threads do not write to
+// the same lines. The size is a multiple of a line so neighbors in the pool
+// array do not share either.
 typedef struct _drop {
-    volatile int	sock;
-    struct pollfd	*pp;
-    struct _perfer	*perfer; // for addr and request body
+    // Set when connecting and otherwise only read.
     struct _pool	*pool;
+    atime		*pipeline; // send times of the outstanding requests, a ring of psize
+    int			psize;
 #ifdef WITH_OPENSSL
     BIO			*bio;
 #endif
+    volatile int64_t	start_time;
+    volatile int	sock;
+    volatile bool	finished;
+
+    // Written by the polling thread.
+    _Alignas(CACHE_LINE) atime	recv_time;
+    struct _drop	*cnext;     // next on the pool changed list
+    int64_t		con_start;  // when the connect was started
+    long		woff;       // bytes of the first unsent request already written
+    int64_t		blocked_at; // when a send last found the socket buffer full
+    int			unsent;     // requests in the pipeline not yet written
+    int			wsock;      // socket registered with epoll
+    uint32_t		wevents;    // events registered with epoll
+#ifdef HAVE_URING
+    uint32_t		gen;   // bumped when the socket is closed
+    bool		armed; // multishot receive armed on the socket
+#endif
+    bool		changed;    // on the pool changed list
+    bool		connecting; // waiting for the connect to complete
+    atomic_int		ptail;
+
+    // Handed between threads.
+    _Alignas(CACHE_LINE) struct _drop	*next; // next on the pool ready list or wake stack
+    struct _drop	*rnext;  // next on the pool closed stack
     atomic_flag		queued;
-    atime		recv_time;
-    atime		pipeline[PIPELINE_SIZE];
-    atomic_int_fast8_t	phead;
-    atomic_int_fast8_t	ptail;
+    atomic_flag		ready;   // on the pool ready list or wake stack
+    atomic_bool		closing; // closed by the receiving thread, not yet reset
 
-    volatile int64_t	start_time;
+    // Written by the receiving thread.
+    _Alignas(CACHE_LINE) atomic_int	phead;
     volatile int64_t	end_time;
-
-    volatile bool	finished;
     long		rcnt;    // recv count
-    long		xsize;   // expected size of message
-    char		buf[MAX_RESP_SIZE];
+    long		xsize;   // bytes of the current response seen so far
+    char		*buf;    // from the pool while bytes are waiting to be parsed
+    struct _resp	resp;    // header parse state for the current response
 } *Drop;
 
-extern void	drop_init(Drop d, struct _pool *pool);
+extern void	drop_init(Drop d, struct _pool *pool, atime *pipeline, int psize);
 extern void	drop_cleanup(Drop d);
+extern void	drop_close(Drop d);
+extern void	drop_closed(Drop d);
 extern int	drop_pending(Drop d);
 
 extern int	drop_connect(Drop d);
+extern int	drop_connected(Drop d);
 extern int	drop_recv(Drop d);
+extern int	drop_received(Drop d, const char *data, long len, int64_t recv_time);
 extern int	drop_warmup_send(Drop d);
 extern int	drop_warmup_recv(Drop d);
 
@@ -0,0 +1,72 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mem.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+// Huge pages are asked for by size as the default hugetlb size may be larger,
+// such as 1G, which would not match the rounding below.
+#define HUGE_PAGE_SIZE	(2UL * 1024UL * 1024UL)
+#ifdef MAP_HUGETLB
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT	26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB	(21 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
+// Blocks of a huge page or more are rounded up to whole huge pages so a
+// mapping of either kind can be unmapped with the same size.
+static size_t
+map_size(size_t size) {
+    if (HUGE_PAGE_SIZE <= size) {
+	size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    }
+    return size;
+}
+
+void*
+mem_alloc(size_t size) {
+    long	page = sysconf(_SC_PAGESIZE);
+    char	*ptr = MAP_FAILED;
+    char	*p;
+
+    size = map_size(size);
+#ifdef MAP_HUGETLB
+    // Only succeeds if 2M huge pages have been reserved.
+    if (HUGE_PAGE_SIZE <= size) {
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+    }
+#endif
+    if (MAP_FAILED == ptr) {
+	if (MAP_FAILED == (ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0))) {
+	    return NULL;
+	}
+#ifdef MADV_HUGEPAGE
+	if (HUGE_PAGE_SIZE <= size) {
+	    madvise(ptr, size, MADV_HUGEPAGE);
+	}
+#endif
+    }
+    if (page <= 0) {
+	page = 4096;
+    }
+    // A write is needed as a read only maps the shared zero page.
+    for (p = ptr; p < ptr + size; p += page) {
+	*(volatile char*)p = 0;
+    }
+    return ptr;
+}
+
+void
+mem_free(void *ptr, size_t size) {
+    if (NULL != ptr) {
+	munmap(ptr, map_size(size));
+    }
+}
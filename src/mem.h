@@ -0,0 +1,15 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#ifndef PERFER_MEM_H
+#define PERFER_MEM_H
+
+#include <stddef.h>
+
+// Large blocks that are mapped directly, backed by huge pages when the system
+// allows, and faulted in by the allocating thread before being returned so no
+// faults are left for later. The pages are placed on the node the thread ran
+// on which is only a fixed node if the thread is pinned.
+extern void*	mem_alloc(size_t size);
+extern void	mem_free(void *ptr, size_t size);
+
+#endif /* PERFER_MEM_H */
@@ -23,6 +23,7 @@
 #endif
 
 #include "arg.h"
+#include "cpu.h"
 #include "drop.h"
 #include "dtime.h"
 #include "pool.h"
@@ -46,6 +47,7 @@ typedef struct _results {
     double	lat;
     double	rate;
     int64_t	bytes;
+    struct _cpu	cpu;
 } *Results;
 
 static struct _perfer	perfer = {
@@ -62,13 +64,19 @@ static struct _perfer	perfer = {
     .tcnt = 1,
     .ccnt = 1,
     .meter = 0,
+    .arrival = ARRIVAL_FIXED,
+    .profile_file = NULL,
+    .profile = { .segs = NULL, .duration = 0.0 },
+    .seed = 0,
     .graph_width = 0,
     .graph_height = 0,
     .duration = 1.0,
+    .interval = 0.0,
     .req_file = NULL,
     .req_body = NULL,
     .req_len = 0,
-    .backlog = 1, // PIPELINE_SIZE - 1,
+    .backlog = 1,
+    .digits = 3,
     .poll_timeout = 0,
     .keep_alive = false,
     .verbose = false,
@@ -76,6 +84,18 @@ static struct _perfer	perfer = {
     .tls = false,
     .json = false,
     .use_epoll = false,
+    .inline_recv = false,
+    .use_uring = false,
+    .metered = false,
+    .saturate = true,
+    .find_max = false,
+    .burst = 0,
+    .every = 1.0,
+    .connect_rate = 0.0,
+    .connect_max = 0,
+    .notsent_lowat = 0,
+    .slo_percent = 0.0,
+    .slo_ns = 0,
     .headers = NULL,
     .spread = NULL,
 };
@@ -96,20 +116,89 @@ static const char	*help_lines[] = {
     "  -d <duration>           Duration in seconds for the run. Positive decimal",
     "  --duration <duration>   values are accepted.",
     "",
-    "  -m <rate>               Set a metering rate in request per second.",
-    "  --meter <rate>          (default: 0, indicating no metering)",
+    "  -i <seconds>            Report results for each interval of the duration",
+    "  --interval <seconds>    specified while the run is in progress.",
+    "",
+    "  -m <rate>               Set a metering rate in request per second. Latency",
+    "  --meter <rate>          is measured from when each request should have been",
+    "                          sent. (default: 0, indicating no metering)",
+    "",
+    "  --profile <file>        Meter with rates that change over time as described",
+    "                          in the file. Each line is a segment of one of:",
+    "                            step <rate> <seconds>",
+    "                            ramp <from-rate> <to-rate> <seconds>",
+    "                            sine <mean-rate> <amplitude> <period> <seconds>",
+    "                          The duration is the total of the segments.",
+    "",
+    "  --find-max              Search for the highest metered rate that meets the",
+    "                          latency SLO. Each probe runs for the duration over",
+    "                          the same connections. The meter rate, if given, is",
+    "                          the first probe rate.",
+    "",
+    "  --slo p<percent>=<time> Latency objective for --find-max such as p99=5ms.",
+    "                          Units of ns, us, ms, or s. (default: ms)",
+    "",
+    "  --burst <number>        Send bursts of the number of requests given spread",
+    "                          over all connections. The connections in all the",
+    "                          threads are released at the same instant. Results",
+    "                          are reported for each burst.",
+    "",
+    "  --every <seconds>       Time between the start of each burst. (default: 1)",
+    "",
+    "  --arrival <kind>        Spacing of metered requests. One of fixed, uniform,",
+    "                          or poisson. (default: fixed)",
+    "",
+    "  --seed <number>         Seed for the random arrival spacing. (default: time)",
     "",
     "  -t <number>             Number of threads to use for sending requests and",
     "  --threads <number>      receiving responses. (default: 1)",
     "",
+    "  --inline                Receive responses on the same thread that polls and",
+    "                          sends instead of handing them off to a receiving",
+    "                          thread. Each thread then runs to completion.",
+    "",
+    "  --uring                 Use io_uring for sending and receiving. Receives run",
+    "                          on the polling thread as with --inline. Requires",
+    "                          keep-alive connections and Linux. Falls back to",
+    "                          epoll on kernels before 6.0.",
+    "",
+    "  --discard               Bandwidth mode. Response bodies of a known length",
+    "                          are dropped by the kernel with MSG_TRUNC instead of",
+    "                          being read. Reports Gb/s and bytes per CPU cycle.",
+    "                          Requires Linux and can not be used with --uring.",
+    "",
+    "  --cpus <list>           Pin the threads to the CPUs given such as 0-3,8,10.",
+    "                          With two CPUs for each thread the polling and",
+    "                          receiving threads each get one, otherwise they",
+    "                          share one. Requires Linux.",
+    "",
+    "  --fifo                  Run the threads with the SCHED_FIFO real-time",
+    "                          policy. Usually requires root or CAP_SYS_NICE.",
+    "                          Use CPUs the server does not run on as the threads",
+    "                          can starve other work on the same CPUs.",
+    "",
     "  -c <number>             Total number of connection to use for sending",
     "  --connections <number>  requests (default: 1)",
     "",
+    "  --connect-rate <number> Most new connections to open per second. Connects",
+    "                          do not block so many can be in progress at once.",
+    "                          (default: no limit)",
+    "",
+    "  --connect-max <number>  Most connects in progress at once. (default: no",
+    "                          limit)",
+    "",
+    "  --notsent-lowat <bytes> Set TCP_NOTSENT_LOWAT on each connection so a",
+    "                          socket only reports room to write once the unsent",
+    "                          data falls below the number of bytes given.",
+    "",
     "  -b <number>             Maximum backlog for pipeline on a connection.",
-    "  --backlog <number>      (default: 1, range 1 - 15)",
+    "  --backlog <number>      (default: 1, range 1 - 4096)",
     "",
     "  -l <percent,...>        Percentages of latency spread to report.",
-    "  --latency <percent,...> (example: 10,20,30,40,50,60,70,80,90,99)",
+    "  --latency <percent,...> (example: 10,20,30,40,50,60,70,80,90,99.9)",
+    "",
+    "  -s <digits>             Significant digits of precision for latency.",
+    "  --significant <digits>  (default: 3, range 1 - 4)",
     "",
     "  -g <wide>x<high>        Print a latency graph with the dimensions specified.",
     "  --graph <wide>x<high>",
@@ -200,6 +289,81 @@ has_keep_alive(const char *str) {
     return has;
 }
 
+// Parses an SLO such as p99=5ms or p99.9=800us. Times without units are in
+// milliseconds.
+static int
+parse_slo(Perfer p, const char *str) {
+    char	*end;
+    double	t;
+
+    if ('p' != *str && 'P' != *str) {
+	return -1;
+    }
+    p->slo_percent = strtod(str + 1, &end);
+    if ('=' != *end || 0.0 >= p->slo_percent || 100.0 < p->slo_percent) {
+	return -1;
+    }
+    t = strtod(end + 1, &end);
+    if (0.0 >= t) {
+	return -1;
+    }
+    if ('\0' == *end || 0 == strcmp("ms", end)) {
+	t *= 1000000.0;
+    } else if (0 == strcmp("us", end)) {
+	t *= 1000.0;
+    } else if (0 == strcmp("s", end)) {
+	t *= 1000000000.0;
+    } else if (0 != strcmp("ns", end)) {
+	return -1;
+    }
+    p->slo_ns = (int64_t)t;
+
+    return 0;
+}
+
+// Parses a list of CPUs such as 0-3,8,10 keeping the order given.
+static int
+parse_cpus(Perfer p, const char *str) {
+    int		max = cpu_count();
+    char	*end;
+    long	first;
+    long	last;
+
+    free(p->cpus);
+    if (NULL == (p->cpus = (int*)malloc(sizeof(int) * MAX_CPUS))) {
+	return -1;
+    }
+    p->cpu_cnt = 0;
+    while (true) {
+	first = strtol(str, &end, 10);
+	if (end == str || first < 0 || max <= first) {
+	    return -1;
+	}
+	last = first;
+	if ('-' == *end) {
+	    str = end + 1;
+	    last = strtol(str, &end, 10);
+	    if (end == str || last < first || max <= last) {
+		return -1;
+	    }
+	}
+	for (; first <= last; first++) {
+	    if (MAX_CPUS <= p->cpu_cnt) {
+		return -1;
+	    }
+	    p->cpus[p->cpu_cnt++] = (int)first;
+	}
+	if ('\0' == *end) {
+	    break;
+	}
+	if (',' != *end) {
+	    return -1;
+	}
+	str = end + 1;
+    }
+    return 0;
+}
+
 static int
 parse_url(Perfer p) {
     const char	*url = p->url;
@@ -271,15 +435,18 @@ init_pools(Perfer p) {
     }
     for (i = p->tcnt, pool = p->pools; 0 < i; i--, pool++) {
 	if (0 < rem) {
-	    if (0 != (err = pool_init(pool, p, dcnt + 1))) {
+	    if (0 != (err = pool_init(pool, p, p->tcnt - i, dcnt + 1))) {
 		return err;
 	    }
 	    rem--;
 	} else {
-	    if (0 != (err = pool_init(pool, p, dcnt))) {
+	    if (0 != (err = pool_init(pool, p, p->tcnt - i, dcnt))) {
 		return err;
 	    }
 	}
+	if (pool != p->pools) {
+	    pool->first = pool[-1].first + pool[-1].dcnt;
+	}
     }
     return 0;
 }
@@ -295,14 +462,8 @@ perfer_init(Perfer p, int argc, const char **argv) {
 	printf("%s\n", strerror(errno));
 	return -1;
     }
-    atomic_init(&p->sent_cnt, 0);
-    atomic_init(&p->con_cnt, 0);
-    atomic_init(&p->err_cnt, 0);
-    atomic_init(&p->byte_cnt, 0);
     atomic_init(&p->ready_cnt, 0);
 
-    stagger_init();
-
     argv++;
     argc--;
     for (; 0 < argc; argc -= cnt, argv += cnt) {
@@ -350,6 +511,23 @@ perfer_init(Perfer p, int argc, const char **argv) {
 	    help(app_name);
 	    return -1;
 	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "i", "-interval")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->interval = strtod(opt_val, &end);
+	    if ('\0' != *end || 0.0 >= p->interval) {
+		printf("'%s' is not a valid interval.\n", opt_val);
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
 	switch (cnt = arg_match(argc, argv, &opt_val, "g", "-graph")) {
 	case 0: // no match
 	    break;
@@ -413,7 +591,7 @@ perfer_init(Perfer p, int argc, const char **argv) {
 	case 1:
 	case 2:
 	    p->backlog = strtol(opt_val, &end, 10);
-	    if ('\0' != *end || 1 > p->backlog || PIPELINE_SIZE <= p->backlog) {
+	    if ('\0' != *end || 1 > p->backlog || MAX_BACKLOG < p->backlog) {
 		printf("'%s' is not a valid backlog number.\n", opt_val);
 		help(app_name);
 		return -1;
@@ -424,6 +602,23 @@ perfer_init(Perfer p, int argc, const char **argv) {
 	    help(app_name);
 	    return -1;
 	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "s", "-significant")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->digits = strtol(opt_val, &end, 10);
+	    if ('\0' != *end || STAGGER_MIN_DIGITS > p->digits || STAGGER_MAX_DIGITS < p->digits) {
+		printf("'%s' is not a valid number of significant digits.\n", opt_val);
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
 	switch (cnt = arg_match(argc, argv, &opt_val, "m", "-meter")) {
 	case 0: // no match
 	    break;
@@ -441,6 +636,162 @@ perfer_init(Perfer p, int argc, const char **argv) {
 	    help(app_name);
 	    return -1;
 	}
+	switch (cnt = arg_match(argc, argv, &p->profile_file, "-profile", "-profile")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, NULL, "-find-max", "-find-max")) {
+	case 0: // no match
+	    break;
+	case 1:
+	    p->find_max = true;
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "-slo", "-slo")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    if (0 != parse_slo(p, opt_val)) {
+		printf("'%s' is not a valid SLO.\n", opt_val);
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "-burst", "-burst")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->burst = strtol(opt_val, &end, 10);
+	    if ('\0' != *end || 1 > p->burst) {
+		printf("'%s' is not a valid burst size.\n", opt_val);
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "-connect-rate", "-connect-rate")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->connect_rate = strtod(opt_val, &end);
+	    if ('\0' != *end || 0.0 >= p->connect_rate) {
+		printf("'%s' is not a valid connect rate.\n", opt_val);
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "-connect-max", "-connect-max")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->connect_max = strtol(opt_val, &end, 10);
+	    if ('\0' != *end || 1 > p->connect_max) {
+		printf("'%s' is not a valid connect maximum.\n", opt_val);
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "-notsent-lowat", "-notsent-lowat")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->notsent_lowat = (int)strtol(opt_val, &end, 10);
+	    if ('\0' != *end || 1 > p->notsent_lowat) {
+		printf("'%s' is not a valid low water mark.\n", opt_val);
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "-every", "-every")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->every = strtod(opt_val, &end);
+	    if ('\0' != *end || 0.01 > p->every) {
+		printf("'%s' is not a valid burst period.\n", opt_val);
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "-arrival", "-arrival")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    if (0 != arrival_kind(opt_val, &p->arrival)) {
+		printf("'%s' is not a valid arrival kind.\n", opt_val);
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "-seed", "-seed")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->seed = strtoull(opt_val, &end, 10);
+	    if ('\0' != *end) {
+		printf("'%s' is not a valid seed.\n", opt_val);
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
 	switch (cnt = arg_match(argc, argv, &p->req_file, "r", "-request")) {
 	case 0: // no match
 	    break;
@@ -552,6 +903,70 @@ perfer_init(Perfer p, int argc, const char **argv) {
 	    help(app_name);
 	    return -1;
 	}
+	switch (cnt = arg_match(argc, argv, NULL, "-inline", "-inline")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->inline_recv = true;
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, NULL, "-uring", "-uring")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->use_uring = true;
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, &opt_val, "-cpus", "-cpus")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    if (0 != parse_cpus(p, opt_val)) {
+		printf("*-*-* Invalid CPU list '%s'. CPUs must be less than %d.\n", opt_val, cpu_count());
+		help(app_name);
+		return -1;
+	    }
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, NULL, "-fifo", "-fifo")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->fifo = true;
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
+	switch (cnt = arg_match(argc, argv, NULL, "-discard", "-discard")) {
+	case 0: // no match
+	    break;
+	case 1:
+	case 2:
+	    p->discard = true;
+	    continue;
+	    break;
+	default: // match but something went wrong
+	    help(app_name);
+	    return -1;
+	}
 	switch (cnt = arg_match(argc, argv, NULL, "e", "-epoll")) {
 	case 0: // no match
 	    break;
@@ -595,7 +1010,52 @@ perfer_init(Perfer p, int argc, const char **argv) {
     if (0 != parse_url(p)) {
 	return -1;
     }
-    if (0 != init_pools(p)) {
+    if (0 == p->seed) {
+	p->seed = (uint64_t)ntime();
+    }
+    if (NULL != p->profile_file) {
+	if (0 < p->meter) {
+	    printf("*-*-* The meter and profile options can not be used together.\n");
+	    return -1;
+	}
+	if (0 != profile_load(&p->profile, p->profile_file)) {
+	    return -1;
+	}
+	p->duration = p->profile.duration;
+    }
+    if (p->find_max) {
+	if (0 == p->slo_ns) {
+	    printf("*-*-* The find-max option requires an SLO.\n");
+	    return -1;
+	}
+	if (NULL != p->profile_file || 0.0 < p->interval) {
+	    printf("*-*-* The find-max option can not be used with a profile or interval.\n");
+	    return -1;
+	}
+	if (0 == p->meter) {
+	    p->meter = 1000;
+	}
+	p->paused = true;
+    }
+    p->metered = (0 < p->meter || NULL != p->profile.segs);
+    if (0 < p->burst) {
+	if (p->metered || p->find_max || 0.0 < p->interval) {
+	    printf("*-*-* The burst option can not be used with metering or interval reports.\n");
+	    return -1;
+	}
+	if ((p->keep_alive ? MAX_BACKLOG * p->ccnt : p->ccnt) < p->burst) {
+	    printf("*-*-* A burst can not be more than %ld requests with %ld connections.\n",
+		   p->keep_alive ? MAX_BACKLOG * p->ccnt : p->ccnt, p->ccnt);
+	    return -1;
+	}
+    }
+    p->saturate = !p->metered && 0 == p->burst;
+    atomic_init(&p->burst_seq, 0);
+    if (0 != stagger_init(&p->lat, p->digits) ||
+	0 != stagger_init(&p->send_lag, p->digits) ||
+	0 != stagger_init(&p->con_lat, p->digits) ||
+	0 != stagger_init(&p->blocked, p->digits)) {
+	printf("*-*-* Not enough memory for latency tracking.\n");
 	return -1;
     }
     if (NULL == p->req_file) {
@@ -632,11 +1092,67 @@ perfer_init(Perfer p, int argc, const char **argv) {
 	p->keep_alive = has_keep_alive(p->req_body);
 	p->replace = (NULL != strstr(p->req_body, "${sequence}"));
     }
-    p->inited = true;
-    p->addr_info = get_addr_info(p->addr, p->port);
-    if (!p->keep_alive || 0 < p->meter) {
+    if (p->use_uring) {
+#ifdef HAVE_URING
+	if (!p->keep_alive) {
+	    printf("*-*-* The uring option requires keep-alive connections.\n");
+	    return -1;
+	}
+	p->inline_recv = true;
+	if (!uring_probe()) {
+	    // Still one thread for each pool but waiting with epoll.
+	    if (!p->json) {
+		printf("-*-*- io_uring multishot receives are not available, Linux 6.0 or later is needed. Using epoll.\n");
+	    }
+	    p->use_uring = false;
+	    p->use_epoll = true;
+	}
+#else
+	printf("*-*-* io_uring is not supported by this build.\n");
+	return -1;
+#endif
+    }
+    if (p->discard) {
+#ifdef __linux__
+	if (p->use_uring) {
+	    printf("*-*-* The discard option can not be used with uring.\n");
+	    return -1;
+	}
+#else
+	printf("*-*-* The discard option requires Linux.\n");
+	return -1;
+#endif
+    }
+    if (0 < p->cpu_cnt) {
+#ifdef __linux__
+	if (p->cpu_cnt < p->tcnt) {
+	    printf("*-*-* The cpus option needs at least one CPU for each of the %ld threads.\n", p->tcnt);
+	    return -1;
+	}
+#else
+	printf("*-*-* The cpus option requires Linux.\n");
+	return -1;
+#endif
+    }
+    // The pipelines are sized from the backlog when the pools are set up. A
+    // burst leaves room for one more in case the last is not all answered.
+    if (!p->keep_alive || p->metered) {
 	p->backlog = 1;
+    } else if (0 < p->burst) {
+	long	per = (p->burst + p->ccnt - 1) / p->ccnt * 2;
+
+	if (MAX_BACKLOG < per) {
+	    per = MAX_BACKLOG;
+	}
+	if (p->backlog < per) {
+	    p->backlog = (int)per;
+	}
+    }
+    if (0 != init_pools(p)) {
+	return -1;
     }
+    p->inited = true;
+    p->addr_info = get_addr_info(p->addr, p->port);
 #ifdef WITH_OPENSSL
     if (p->tls) {
 	SSL_load_error_strings();
@@ -661,7 +1177,22 @@ perfer_cleanup(Perfer p) {
     }
     free(p->addr_info);
     free(p->pools);
+    profile_cleanup(&p->profile);
+    stagger_cleanup(&p->lat);
+    stagger_cleanup(&p->send_lag);
+    stagger_cleanup(&p->con_lat);
+    stagger_cleanup(&p->blocked);
     free(p->req_body);
+    free(p->cpus);
+}
+
+// Target rate in requests per second at a time in nanoseconds.
+double
+perfer_rate(Perfer p, int64_t at) {
+    if (NULL != p->profile.segs) {
+	return profile_rate(&p->profile, (double)at / 1000000000.0 - p->start_time);
+    }
+    return (double)p->meter;
 }
 
 void
@@ -678,7 +1209,7 @@ perfer_stop(Perfer p) {
 }
 
 static void
-lat_graph(int w, int h) {
+lat_graph(Stagger lat, int w, int h) {
     w++;
     char	g[h * w];
     char	*r;
@@ -697,7 +1228,7 @@ lat_graph(int w, int h) {
     printf("Latency Distribution\n");
     printf("%s\n", sep);
 
-    uint64_t	lw = stagger_at(0.95); // width of latency
+    uint64_t	lw = stagger_at(lat, 0.95); // width of latency
     uint64_t	lh = 1;
     uint64_t	vals[w];
     uint64_t	linc = lw / w;
@@ -716,7 +1247,7 @@ lat_graph(int w, int h) {
     linc = 1ULL << (i * 4);
     memset(vals, 0, sizeof(vals));
     for (i = 0, min = linc; i < w - 1; i++, min += linc) {
-	v = stagger_range(min, min + linc);
+	v = stagger_range(lat, min, min + linc);
 	vals[i] = v;
 	if (lh < v) {
 	    lh = v;
@@ -733,6 +1264,29 @@ lat_graph(int w, int h) {
     printf("%s\n\n", sep);
 }
 
+// Describes the CPUs the threads were pinned to as poll/recv pairs or as
+// one CPU for each thread when they share.
+static const char*
+topology(Perfer p, char *buf, size_t size) {
+    Pool	pool;
+    int		i;
+    size_t	len = 0;
+
+    *buf = '\0';
+    if (0 == p->cpu_cnt) {
+	snprintf(buf, size, "not pinned");
+	return buf;
+    }
+    for (pool = p->pools, i = p->tcnt; 0 < i && len < size; i--, pool++) {
+	if (pool->poll_cpu == pool->recv_cpu) {
+	    len += snprintf(buf + len, size - len, "%s%d", pool == p->pools ? "" : " ", pool->poll_cpu);
+	} else {
+	    len += snprintf(buf + len, size - len, "%s%d/%d", pool == p->pools ? "" : " ", pool->poll_cpu, pool->recv_cpu);
+	}
+    }
+    return buf;
+}
+
 static void
 print_out(Perfer p, Results r) {
     if (0 < r->err_cnt) {
@@ -748,9 +1302,21 @@ print_out(Perfer p, Results r) {
 	   (NULL == p->port) ? "80" : p->port,
 	   NULL == p->path ? "" : p->path);
     printf("  Threads:         %ld\n", p->tcnt);
+    if (0 < p->cpu_cnt || p->fifo) {
+	char	buf[256];
+
+	printf("  CPUs:            %s%s of %d%s\n",
+	       topology(p, buf, sizeof(buf)),
+	       (0 < p->cpu_cnt && p->pools->poll_cpu != p->pools->recv_cpu) ? " poll/recv" : "",
+	       cpu_count(),
+	       p->fifo ? ", SCHED_FIFO" : "");
+    }
     printf("  Connections:     %ld\n", p->ccnt);
     printf("  Duration:        %0.1f seconds\n", r->psum);
     printf("  Keep-Alive:      %s\n", p->keep_alive ? "true" : "false");
+    if (NULL != p->profile_file) {
+	printf("  Profile:         %s\n", p->profile_file);
+    }
     printf("Results:\n");
     if (0 < r->err_cnt) {
 	printf("  Failures:        %ld\n", r->err_cnt);
@@ -758,18 +1324,43 @@ print_out(Perfer p, Results r) {
     printf("  Connections:     %ld connection established\n", (long)r->con_cnt);
     printf("  Requests:        %ld requests\n", (long)r->ok_cnt);
     printf("  Received:        %0.3f MB (%0.3f MB/sec)\n", (double)r->bytes / 1024.0 /1024.0, (double)r->bytes / 1024.0 /1024.0 / r->psum);
+    if (p->discard && 0.0 < r->psum) {
+	printf("  Bandwidth:       %0.3f Gb/s  %0.3f bytes/cycle%s  %0.3f CPU secs\n",
+	       (double)r->bytes * 8.0 / r->psum / 1000000000.0,
+	       0.0 < r->cpu.cycles ? (double)r->bytes / r->cpu.cycles : 0.0,
+	       r->cpu.estimated ? " (est)" : "",
+	       r->cpu.secs);
+    }
     printf("  Throughput:      %ld requests/second\n", (long)r->rate);
-    printf("  Average Latency: %0.3f +/-%0.3f msecs (and stdev)\n", stagger_average() / 1000000.0, stagger_stddev() / 1000000.0);
+    printf("  Average Latency: %0.3f +/-%0.3f msecs (and stdev)\n", stagger_average(&p->lat) / 1000000.0, stagger_stddev(&p->lat) / 1000000.0);
     if (NULL == p->spread) {
-	printf("  Mean Latency:    %0.3f\n", stagger_at(0.5) / 1000000.0);
+	printf("  Mean Latency:    %0.3f\n", stagger_at(&p->lat, 0.5) / 1000000.0);
     } else {
 	printf("  Latency Spread:\n");
 	for (Spread s = p->spread; NULL != s; s = s->next) {
-	    printf("     % 3.2f%%:      %0.3f msecs\n", s->percent, stagger_at(s->percent / 100.0) / 1000000.0);
+	    printf("     % 3.2f%%:      %0.3f msecs\n", s->percent, stagger_at(&p->lat, s->percent / 100.0) / 1000000.0);
 	}
     }
+    if (p->metered) {
+	printf("  Send Lag:        %0.3f avg  %0.3f at 99%%  %0.3f max msecs\n",
+	       stagger_average(&p->send_lag) / 1000000.0,
+	       stagger_at(&p->send_lag, 0.99) / 1000000.0,
+	       stagger_max(&p->send_lag) / 1000000.0);
+    }
+    if (0 < stagger_count(&p->con_lat)) {
+	printf("  Connect Time:    %0.3f avg  %0.3f at 99%%  %0.3f max msecs\n",
+	       stagger_average(&p->con_lat) / 1000000.0,
+	       stagger_at(&p->con_lat, 0.99) / 1000000.0,
+	       stagger_max(&p->con_lat) / 1000000.0);
+    }
+    if (0 < stagger_count(&p->blocked)) {
+	printf("  Send Blocked:    %llu stalls  %0.3f avg  %0.3f max msecs\n",
+	       (unsigned long long)stagger_count(&p->blocked),
+	       stagger_average(&p->blocked) / 1000000.0,
+	       stagger_max(&p->blocked) / 1000000.0);
+    }
     if (0 < p->graph_width && 0 < p->graph_height) {
-	lat_graph(p->graph_width, p->graph_height);
+	lat_graph(&p->lat, p->graph_width, p->graph_height);
     }
     printf("\n");
 }
@@ -784,9 +1375,19 @@ json_out(Perfer p, Results r) {
 	   (NULL == p->port) ? "80" : p->port,
 	   NULL == p->path ? "" : p->path);
     printf("    \"threads\": %ld,\n", p->tcnt);
+    if (0 < p->cpu_cnt || p->fifo) {
+	char	buf[256];
+
+	printf("    \"cpus\": \"%s\",\n", topology(p, buf, sizeof(buf)));
+	printf("    \"cpuCount\": %d,\n", cpu_count());
+	printf("    \"fifo\": %s,\n", p->fifo ? "true" : "false");
+    }
     printf("    \"connections\": %ld,\n", p->ccnt);
     printf("    \"duration\": %0.1f,\n", r->psum);
-    printf("    \"keepAlive\": %s\n", p->keep_alive ? "true" : "false");
+    printf("    \"keepAlive\": %s%s\n", p->keep_alive ? "true" : "false", NULL == p->profile_file ? "" : ",");
+    if (NULL != p->profile_file) {
+	printf("    \"profile\": \"%s\"\n", p->profile_file);
+    }
     printf("  },\n");
     printf("  \"results\": {\n");
     if (0 < r->err_cnt) {
@@ -799,16 +1400,37 @@ json_out(Perfer p, Results r) {
 	printf("    \"noResponse\": %ld,\n", r->sent_cnt - r->ok_cnt - r->err_cnt);
     }
     printf("    \"connections\": %ld,\n", (long)r->con_cnt);
+    if (0 < stagger_count(&p->con_lat)) {
+	printf("    \"connectAverageMilliseconds\": %0.3f,\n", stagger_average(&p->con_lat) / 1000000.0);
+	printf("    \"connect99Milliseconds\": %0.3f,\n", stagger_at(&p->con_lat, 0.99) / 1000000.0);
+	printf("    \"connectMaxMilliseconds\": %0.3f,\n", stagger_max(&p->con_lat) / 1000000.0);
+    }
+    if (0 < stagger_count(&p->blocked)) {
+	printf("    \"sendBlockedCount\": %llu,\n", (unsigned long long)stagger_count(&p->blocked));
+	printf("    \"sendBlockedAverageMilliseconds\": %0.3f,\n", stagger_average(&p->blocked) / 1000000.0);
+	printf("    \"sendBlockedMaxMilliseconds\": %0.3f,\n", stagger_max(&p->blocked) / 1000000.0);
+    }
     printf("    \"requests\": %ld,\n", (long)r->ok_cnt);
     printf("    \"requestsPerSecond\": %ld,\n", (long)r->rate);
     printf("    \"totalBytes\": %lld,\n", r->bytes);
-    printf("    \"latencyAverageMilliseconds\": %0.3f,\n", stagger_average() / 1000000.0);
-    printf("    \"latencyMeanMilliseconds\": %0.3f,\n", stagger_at(0.5) / 1000000.0);
-    printf("    \"latencyStdev\": %0.3f%s\n", stagger_stddev() / 1000000.0, NULL != p->spread ? "," : "");
+    if (p->discard && 0.0 < r->psum) {
+	printf("    \"gigabitsPerSecond\": %0.3f,\n", (double)r->bytes * 8.0 / r->psum / 1000000000.0);
+	printf("    \"bytesPerCycle\": %0.3f,\n", 0.0 < r->cpu.cycles ? (double)r->bytes / r->cpu.cycles : 0.0);
+	printf("    \"cyclesEstimated\": %s,\n", r->cpu.estimated ? "true" : "false");
+	printf("    \"cpuSeconds\": %0.3f,\n", r->cpu.secs);
+    }
+    printf("    \"latencyAverageMilliseconds\": %0.3f,\n", stagger_average(&p->lat) / 1000000.0);
+    printf("    \"latencyMeanMilliseconds\": %0.3f,\n", stagger_at(&p->lat, 0.5) / 1000000.0);
+    printf("    \"latencyStdev\": %0.3f%s\n", stagger_stddev(&p->lat) / 1000000.0, (NULL != p->spread || p->metered) ? "," : "");
+    if (p->metered) {
+	printf("    \"sendLagAverageMilliseconds\": %0.3f,\n", stagger_average(&p->send_lag) / 1000000.0);
+	printf("    \"sendLag99Milliseconds\": %0.3f,\n", stagger_at(&p->send_lag, 0.99) / 1000000.0);
+	printf("    \"sendLagMaxMilliseconds\": %0.3f%s\n", stagger_max(&p->send_lag) / 1000000.0, NULL != p->spread ? "," : "");
+    }
     if (NULL != p->spread) {
 	printf("    \"latencySpread\": {\n");
 	for (Spread s = p->spread; NULL != s; s = s->next) {
-	    printf("      \"%3.2f\": %0.3f%s\n", s->percent, stagger_at(s->percent / 100.0) / 1000000.0, NULL == s->next ? "" : ",");
+	    printf("      \"%3.2f\": %0.3f%s\n", s->percent, stagger_at(&p->lat, s->percent / 100.0) / 1000000.0, NULL == s->next ? "" : ",");
 	}
 	printf("    }\n");
     }
@@ -816,6 +1438,406 @@ json_out(Perfer p, Results r) {
     printf("}\n");
 }
 
+static struct _spread	default_spread[] = {
+    { .next = default_spread + 1, .percent = 50.0 },
+    { .next = default_spread + 2, .percent = 90.0 },
+    { .next = default_spread + 3, .percent = 99.0 },
+    { .next = NULL, .percent = 99.9 },
+};
+
+static uint64_t
+tally_diff(atomic_uint_fast64_t *cur, atomic_uint_fast64_t *prev) {
+    return atomic_load(cur) - atomic_load(prev);
+}
+
+static void
+interval_out(Perfer p, int n, double elapsed, double secs, double target, Tally cur, Tally prev, Stagger lat) {
+    Spread	spread = (NULL == p->spread) ? default_spread : p->spread;
+    uint64_t	ok = stagger_count(lat);
+    double	bytes = (double)tally_diff(&cur->byte_cnt, &prev->byte_cnt);
+    uint64_t	errs = tally_diff(&cur->err_cnt, &prev->err_cnt);
+
+    pthread_mutex_lock(&p->print_mutex);
+    if (p->json) {
+	printf("{\"interval\": %d, \"time\": %0.3f, ", n, elapsed);
+	if (p->metered) {
+	    printf("\"targetPerSecond\": %ld, ", (long)target);
+	}
+	printf("\"requests\": %llu, \"requestsPerSecond\": %ld, \"bytesPerSecond\": %ld, \"errors\": %llu, \"latencyAverageMilliseconds\": %0.3f, \"latencySpread\": {",
+	       (unsigned long long)ok, (long)(ok / secs), (long)(bytes / secs), (unsigned long long)errs, stagger_average(lat) / 1000000.0);
+	for (Spread s = spread; NULL != s; s = s->next) {
+	    printf("\"%3.2f\": %0.3f%s", s->percent, stagger_at(lat, s->percent / 100.0) / 1000000.0, NULL == s->next ? "" : ", ");
+	}
+	printf("}}\n");
+    } else {
+	if (1 == n) {
+	    printf("    Time");
+	    if (p->metered) {
+		printf("   Target/sec");
+	    }
+	    printf("  Requests/sec      MB/sec  Errors");
+	    for (Spread s = spread; NULL != s; s = s->next) {
+		printf(" % 8.2f%%", s->percent);
+	    }
+	    printf("  (msecs)\n");
+	}
+	printf("% 8.1f", elapsed);
+	if (p->metered) {
+	    printf("  % 11ld", (long)target);
+	}
+	printf("  % 12ld  % 10.3f  %6llu", (long)(ok / secs), bytes / 1024.0 / 1024.0 / secs, (unsigned long long)errs);
+	for (Spread s = spread; NULL != s; s = s->next) {
+	    printf(" % 9.3f", stagger_at(lat, s->percent / 100.0) / 1000000.0);
+	}
+	printf("\n");
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&p->print_mutex);
+}
+
+// Collects and reports results for each interval until enough. The pools are
+// rotated so the receiving threads never wait on the reporter. Each interval
+// is merged into the totals once reported.
+static void*
+report_loop(void *x) {
+    Perfer		p = (Perfer)x;
+    struct _stagger	lat;
+    struct _tally	prev;
+    struct _tally	cur;
+    Pool		pool;
+    int			i;
+    int			n = 1;
+    double		start = p->start_time;
+    double		last = start;
+    double		next = start + p->interval;
+    double		now;
+    double		target;
+
+    if (0 != stagger_init(&lat, p->digits)) {
+	printf("*-*-* Not enough memory for interval reports.\n");
+	return NULL;
+    }
+    memset(&prev, 0, sizeof(prev));
+    while (!p->enough) {
+	if ((now = dtime()) < next) {
+	    dsleep(next - now < 0.01 ? next - now : 0.01);
+	    continue;
+	}
+	memset(&cur, 0, sizeof(cur));
+	for (pool = p->pools, i = p->tcnt; 0 < i; i--, pool++) {
+	    pool_rotate(pool, &lat);
+	    pool_tally(pool, &cur);
+	}
+	if (NULL != p->profile.segs) {
+	    target = profile_mean(&p->profile, last - p->start_time, now - p->start_time);
+	} else {
+	    target = (double)p->meter;
+	}
+	interval_out(p, n, now - start, now - last, target, &cur, &prev, &lat);
+	stagger_merge(&p->lat, &lat);
+	stagger_reset(&lat);
+	memcpy(&prev, &cur, sizeof(prev));
+	last = now;
+	next += p->interval;
+	n++;
+    }
+    stagger_cleanup(&lat);
+
+    return NULL;
+}
+
+#define MAX_PROBES	24
+
+typedef struct _probe {
+    long	target;
+    double	rate;
+    uint64_t	err_cnt;
+    bool	pass;
+    double	at_slo; // milliseconds
+    double	spread[8];
+} *Probe;
+
+// Collects the latency and counts from all the pools.
+static void
+collect(Perfer p, Stagger lat, Tally t) {
+    Pool	pool;
+    int		i;
+
+    memset(t, 0, sizeof(struct _tally));
+    for (pool = p->pools, i = p->tcnt; 0 < i; i--, pool++) {
+	pool_rotate(pool, lat);
+	pool_tally(pool, t);
+    }
+}
+
+static void
+drain(Perfer p, double timeout) {
+    double	giveup = dtime() + timeout;
+    Pool	pool;
+    int		i;
+    long	cnt;
+
+    while (dtime() < giveup) {
+	cnt = 0;
+	for (pool = p->pools, i = p->tcnt; 0 < i; i--, pool++) {
+	    cnt += pool_pending(pool);
+	}
+	if (0 == cnt) {
+	    break;
+	}
+	dsleep(0.001);
+    }
+}
+
+// Runs one metered phase at the probe target rate over the existing
+// connections. Sending is paused before and after so each probe only sees its
+// own responses.
+static void
+run_probe(Perfer p, Stagger lat, Probe pb) {
+    Spread		spread = (NULL == p->spread) ? default_spread : p->spread;
+    struct _tally	before;
+    struct _tally	after;
+    double		start;
+    double		secs;
+    int			i;
+
+    drain(p, 2.0);
+    collect(p, lat, &before);
+    stagger_reset(lat);
+    p->meter = pb->target;
+    start = dtime();
+    p->paused = false;
+    dsleep(p->duration);
+    p->paused = true;
+    secs = dtime() - start;
+    drain(p, 2.0);
+    collect(p, lat, &after);
+
+    pb->rate = (double)stagger_count(lat) / secs;
+    pb->err_cnt = tally_diff(&after.err_cnt, &before.err_cnt);
+    pb->at_slo = stagger_at(lat, p->slo_percent / 100.0) / 1000000.0;
+    pb->pass = (pb->at_slo * 1000000.0 <= (double)p->slo_ns && (double)pb->target * 0.95 <= pb->rate);
+    for (i = 0; NULL != spread && i < (int)(sizeof(pb->spread) / sizeof(*pb->spread)); i++, spread = spread->next) {
+	pb->spread[i] = stagger_at(lat, spread->percent / 100.0) / 1000000.0;
+    }
+    stagger_merge(&p->lat, lat);
+}
+
+static void
+probe_out(Perfer p, Probe pb, int n) {
+    Spread	spread = (NULL == p->spread) ? default_spread : p->spread;
+    int		i;
+
+    if (p->json) {
+	return;
+    }
+    if (0 == n) {
+	printf("Searching for the max rate with %0.2f%% of latency under %0.3f msecs:\n",
+	       p->slo_percent, (double)p->slo_ns / 1000000.0);
+	printf("  Target/sec  Requests/sec  Errors");
+	for (i = 0; NULL != spread && i < 8; i++, spread = spread->next) {
+	    printf(" % 8.2f%%", spread->percent);
+	}
+	printf(" % 8.2f%%  (msecs)\n", p->slo_percent);
+	spread = (NULL == p->spread) ? default_spread : p->spread;
+    }
+    printf("  % 10ld  % 12ld  %6llu", pb->target, (long)pb->rate, (unsigned long long)pb->err_cnt);
+    for (i = 0; NULL != spread && i < 8; i++, spread = spread->next) {
+	printf(" % 9.3f", pb->spread[i]);
+    }
+    printf(" % 9.3f  %s\n", pb->at_slo, pb->pass ? "pass" : "fail");
+    fflush(stdout);
+}
+
+static void
+find_out(Perfer p, struct _probe *probes, int cnt, Probe best) {
+    if (!p->json) {
+	if (NULL == best) {
+	    printf("No rate probed met the SLO.\n\n");
+	} else {
+	    printf("Max sustainable throughput: %ld requests/second (%ld target)\n\n", (long)best->rate, best->target);
+	}
+	return;
+    }
+    Spread	spread;
+    int		i;
+
+    printf("{\n");
+    printf("  \"options\": {\n");
+    printf("    \"url\": \"%s://%s:%s/%s\",\n",
+	   p->tls ? "https" : "http",
+	   p->addr,
+	   (NULL == p->port) ? "80" : p->port,
+	   NULL == p->path ? "" : p->path);
+    printf("    \"threads\": %ld,\n", p->tcnt);
+    if (0 < p->cpu_cnt || p->fifo) {
+	char	buf[256];
+
+	printf("    \"cpus\": \"%s\",\n", topology(p, buf, sizeof(buf)));
+	printf("    \"cpuCount\": %d,\n", cpu_count());
+	printf("    \"fifo\": %s,\n", p->fifo ? "true" : "false");
+    }
+    printf("    \"connections\": %ld,\n", p->ccnt);
+    printf("    \"probeDuration\": %0.1f,\n", p->duration);
+    printf("    \"keepAlive\": %s,\n", p->keep_alive ? "true" : "false");
+    printf("    \"slo\": { \"percent\": %0.2f, \"milliseconds\": %0.3f }\n", p->slo_percent, (double)p->slo_ns / 1000000.0);
+    printf("  },\n");
+    printf("  \"probes\": [\n");
+    for (Probe pb = probes; pb < probes + cnt; pb++) {
+	printf("    { \"target\": %ld, \"requestsPerSecond\": %ld, \"errors\": %llu, \"latencyAtSlo\": %0.3f, \"pass\": %s, \"latencySpread\": {",
+	       pb->target, (long)pb->rate, (unsigned long long)pb->err_cnt, pb->at_slo, pb->pass ? "true" : "false");
+	spread = (NULL == p->spread) ? default_spread : p->spread;
+	for (i = 0; NULL != spread && i < 8; i++, spread = spread->next) {
+	    printf("\"%3.2f\": %0.3f%s", spread->percent, pb->spread[i], (NULL == spread->next || 7 == i) ? "" : ", ");
+	}
+	printf("}}%s\n", pb + 1 < probes + cnt ? "," : "");
+    }
+    printf("  ],\n");
+    printf("  \"maxRequestsPerSecond\": %ld,\n", NULL == best ? 0L : (long)best->rate);
+    printf("  \"maxTarget\": %ld\n", NULL == best ? 0L : best->target);
+    printf("}\n");
+}
+
+// Doubles the rate until the SLO is missed and then bisects between the
+// highest rate that passed and the lowest that failed.
+static void
+find_max(Perfer p) {
+    struct _probe	probes[MAX_PROBES];
+    struct _stagger	lat;
+    Probe		pb = probes;
+    Probe		best = NULL;
+    long		rate = p->meter;
+    long		lo = 0;
+    long		hi = 0;
+
+    if (0 != stagger_init(&lat, p->digits)) {
+	printf("*-*-* Not enough memory for latency tracking.\n");
+	return;
+    }
+    memset(probes, 0, sizeof(probes));
+    for (; pb < probes + MAX_PROBES; pb++) {
+	pb->target = rate;
+	run_probe(p, &lat, pb);
+	probe_out(p, pb, (int)(pb - probes));
+	if (pb->pass) {
+	    lo = rate;
+	    best = pb;
+	} else {
+	    hi = rate;
+	}
+	if (0 == hi) {
+	    rate *= 2;
+	} else {
+	    if (hi - lo <= hi / 50 || hi - lo < 2) {
+		pb++;
+		break;
+	    }
+	    rate = (lo + hi) / 2;
+	}
+    }
+    find_out(p, probes, (int)(pb - probes), best);
+    stagger_cleanup(&lat);
+}
+
+static void
+burst_out(Perfer p, int n, Tally before, Tally after, Stagger lat, double skew, double drain) {
+    Spread	spread = (NULL == p->spread) ? default_spread : p->spread;
+    uint64_t	ok = stagger_count(lat);
+    uint64_t	errs = tally_diff(&after->err_cnt, &before->err_cnt);
+
+    if (p->json) {
+	printf("{\"burst\": %d, \"requests\": %llu, \"errors\": %llu, \"skewMicroseconds\": %0.1f, \"drainMilliseconds\": %0.3f, \"latencyMaxMilliseconds\": %0.3f, \"latencySpread\": {",
+	       n, (unsigned long long)ok, (unsigned long long)errs, skew / 1000.0, drain / 1000000.0, stagger_max(lat) / 1000000.0);
+	for (Spread s = spread; NULL != s; s = s->next) {
+	    printf("\"%3.2f\": %0.3f%s", s->percent, stagger_at(lat, s->percent / 100.0) / 1000000.0, NULL == s->next ? "" : ", ");
+	}
+	printf("}}\n");
+    } else {
+	if (1 == n) {
+	    printf("   Burst  Requests  Errors  Skew(usecs)  Drain(msecs)");
+	    for (Spread s = spread; NULL != s; s = s->next) {
+		printf(" % 8.2f%%", s->percent);
+	    }
+	    printf("       max  (msecs)\n");
+	}
+	printf("% 8d  %8llu  %6llu  % 11.1f  % 12.3f", n, (unsigned long long)ok, (unsigned long long)errs, skew / 1000.0, drain / 1000000.0);
+	for (Spread s = spread; NULL != s; s = s->next) {
+	    printf(" % 9.3f", stagger_at(lat, s->percent / 100.0) / 1000000.0);
+	}
+	printf(" % 9.3f\n", stagger_max(lat) / 1000000.0);
+    }
+    fflush(stdout);
+}
+
+// Releases a burst every period until the duration is reached. Each burst is
+// given until shortly before the next one to drain.
+static void
+burst_run(Perfer p) {
+    struct _stagger	lat;
+    struct _tally	before;
+    struct _tally	after;
+    int64_t		every = (int64_t)(p->every * 1000000000.0);
+    int64_t		lead = 2000000; // gives the pools time to get ready
+    int64_t		end = ntime() + (int64_t)(p->duration * 1000000000.0);
+    int64_t		at = ntime() + lead;
+    int64_t		first;
+    int64_t		last;
+    int64_t		drain;
+    Pool		pool;
+    Drop		d;
+    int			i;
+    int			j;
+    long		cnt;
+
+    if (0 != stagger_init(&lat, p->digits)) {
+	printf("*-*-* Not enough memory for latency tracking.\n");
+	return;
+    }
+    for (int n = 1; at < end; n++, at += every) {
+	// Late responses to the previous burst only go into the totals.
+	collect(p, &lat, &before);
+	stagger_merge(&p->lat, &lat);
+	stagger_reset(&lat);
+	p->burst_at = at;
+	atomic_store(&p->burst_seq, n);
+	do {
+	    dsleep(0.0005);
+	    cnt = 0;
+	    for (pool = p->pools, i = p->tcnt; 0 < i; i--, pool++) {
+		if (pool->burst_sent != n) {
+		    cnt++; // not all sent yet
+		}
+		cnt += pool_pending(pool);
+	    }
+	} while (0 < cnt && ntime() < at + every - lead);
+	collect(p, &lat, &after);
+
+	first = INT64_MAX;
+	last = 0;
+	drain = at;
+	for (pool = p->pools, i = p->tcnt; 0 < i; i--, pool++) {
+	    if (pool->burst_first < first) {
+		first = pool->burst_first;
+	    }
+	    if (last < pool->burst_first) {
+		last = pool->burst_first;
+	    }
+	    for (d = pool->drops, j = pool->dcnt; 0 < j; j--, d++) {
+		if (drain < d->end_time) {
+		    drain = d->end_time;
+		}
+	    }
+	}
+	burst_out(p, n, &before, &after, &lat, (double)(last - first), (double)(drain - at));
+	stagger_merge(&p->lat, &lat);
+	stagger_reset(&lat);
+	if (at + every < end) {
+	    nwait(at + every - lead - ntime());
+	}
+    }
+    stagger_cleanup(&lat);
+}
+
 static int
 warmup(Perfer p) {
     // Initialize connections before starting the benchmarks.
@@ -840,15 +1862,21 @@ perfer_start(Perfer p) {
     struct _results	r;
     Pool		pool;
     Drop		d;
-    int			tcnt = 0;
+    int			timed = 0; // connections with a start and end time
     double		giveup;
+    struct _tally	tally;
+    bool		reporting = false;
 
     memset(&r, 0, sizeof(r));
+    memset(&tally, 0, sizeof(tally));
     atomic_store(&p->ready_cnt, 0);
 
     if (0 != (err = warmup(p))) {
 	return err;
     }
+    if (p->discard) {
+	cpu_start(&r.cpu);
+    }
     for (i = p->tcnt, pool = p->pools; 0 < i; i--, pool++) {
 	if (0 != (err = pool_start(pool))) {
 	    printf("*-*-* Failed to create IO threads. %s\n", strerror(err));
@@ -857,7 +1885,7 @@ perfer_start(Perfer p) {
 	}
     }
     giveup = dtime() + 4.0;
-    while (atomic_load(&p->ready_cnt) < tcnt * 2) {
+    while (atomic_load(&p->ready_cnt) < (p->inline_recv ? p->tcnt : p->tcnt * 2)) {
 	if (giveup <= dtime()) {
 	    printf("*-*-* timed out waiting for threads to start.\n");
 	    perfer_stop(p);
@@ -865,25 +1893,20 @@ perfer_start(Perfer p) {
 	}
 	dsleep(0.1);
     }
+    p->start_time = dtime();
     p->go = true;
-    if (0 < p->meter) {
-	int64_t	dur = (int64_t)(p->duration * 1000000000.0);
-	int64_t	sep = 1000000000ULL / p->meter;
-	int64_t	done = ntime() + dur;
-	int64_t	next = ntime();
-	int64_t	now;
-	int	dcnt = p->ccnt / p->tcnt;
-
-	for (now = ntime(); now < done; now = ntime()) {
-	    if (next <= now) {
-		pool = p->pools + (i / dcnt) % p->tcnt;
-		pool_send(pool, i);
-		i++;
-		next += sep;
-	    } else {
-		nwait(next - now);
-	    }
+    if (0.0 < p->interval) {
+	if (0 != pthread_create(&p->report_thread, NULL, report_loop, p)) {
+	    printf("*-*-* Failed to create interval reporting thread. %s\n", strerror(errno));
+	} else {
+	    reporting = true;
 	}
+    }
+    // When metering each pool keeps its own schedule.
+    if (p->find_max) {
+	find_max(p);
+    } else if (0 < p->burst) {
+	burst_run(p);
     } else {
 	dsleep(p->duration);
     }
@@ -891,9 +1914,15 @@ perfer_start(Perfer p) {
     for (i = p->tcnt, pool = p->pools; 0 < i; i--, pool++) {
 	pool_wait(pool);
     }
-    if (0 < p->meter) {
+    if (p->discard) {
+	cpu_finish(&r.cpu);
+    }
+    if (reporting) {
+	pthread_join(p->report_thread, NULL);
+    }
+    if (p->metered || 0 < p->burst) {
 	r.psum = p->duration;
-	tcnt = 1;
+	timed = 1;
     } else {
 	int	j;
 
@@ -901,21 +1930,32 @@ perfer_start(Perfer p) {
 	    for (d = pool->drops, j = pool->dcnt; 0 < j; j--, d++) {
 		if (0 < d->start_time && 0 < d->end_time) {
 		    r.psum += (double)(d->end_time - d->start_time) / 1000000000.0;
-		    tcnt++;
+		    timed++;
 		}
 	    }
 	}
     }
-    r.sent_cnt = atomic_load(&p->sent_cnt);
-    r.con_cnt = atomic_load(&p->con_cnt);
-    r.err_cnt = atomic_load(&p->err_cnt);
-    r.bytes = atomic_load(&p->byte_cnt);
-    r.ok_cnt = stagger_count();
+    // The pools are finished so merging without locks is safe.
+    for (i = p->tcnt, pool = p->pools; 0 < i; i--, pool++) {
+	pool_tally(pool, &tally);
+	stagger_merge(&p->lat, pool->lat);
+	stagger_merge(&p->lat, pool->lat + 1);
+	stagger_merge(&p->send_lag, &pool->send_lag);
+	stagger_merge(&p->con_lat, &pool->con_lat);
+	stagger_merge(&p->blocked, &pool->blocked);
+    }
+    r.sent_cnt = (long)atomic_load(&tally.sent_cnt);
+    r.con_cnt = (long)atomic_load(&tally.con_cnt);
+    r.err_cnt = (long)atomic_load(&tally.err_cnt);
+    r.bytes = (int64_t)atomic_load(&tally.byte_cnt);
+    r.ok_cnt = stagger_count(&p->lat);
     if (0.0 < r.psum) {
-	r.psum /= tcnt;
+	r.psum /= timed;
 	r.rate = (double)r.ok_cnt / r.psum;
     }
-    if (p->json) {
+    if (p->find_max) {
+	// Already reported.
+    } else if (p->json) {
 	json_out(p, &r);
     } else {
 	print_out(p, &r);
@@ -938,6 +1978,7 @@ int
 main(int argc, const char **argv) {
     int	err;
 
+    resp_init();
     if (0 != (err = perfer_init(&perfer, argc, argv))) {
 	return err;
     }
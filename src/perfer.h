@@ -7,7 +7,10 @@
 #include <stdatomic.h>
 #include <stdbool.h>
 
+#include "arrival.h"
+#include "profile.h"
 #include "queue.h"
+#include "stagger.h"
 
 struct _pool;
 struct addrinfo;
@@ -27,11 +30,16 @@ typedef struct _perfer {
     volatile bool	done;
     volatile bool	enough;
     volatile bool	go;
+    volatile bool	paused; // metered sending paused between phases
 
     struct _pool	*pools;
     long		tcnt;
     long		ccnt;
-    long		meter;
+    volatile long	meter;
+    ArrivalKind		arrival;
+    const char		*profile_file;
+    struct _profile	profile;
+    uint64_t		seed;
     const char		*url;
     const char		*addr;
     const char		*port;
@@ -39,11 +47,13 @@ typedef struct _perfer {
     const char		*post;
     struct addrinfo	*addr_info;
     double		duration;
+    double		interval;
     double		start_time;
     const char		*req_file;
     char		*req_body;
     long		req_len;
     int			backlog;
+    int			digits;
     int			graph_width;
     int			graph_height;
     int			poll_timeout;
@@ -53,18 +63,38 @@ typedef struct _perfer {
     bool		tls;
     bool		json;
     bool		use_epoll;
+    bool		inline_recv; // receive on the polling thread
+    bool		use_uring;
+    bool		discard; // drop response bodies in the kernel
+    bool		fifo;    // run pool threads with SCHED_FIFO
+    int			*cpus;   // CPUs to pin pool threads to
+    int			cpu_cnt;
+    bool		metered;
+    bool		saturate; // send as fast as possible
+    bool		find_max;
+    double		slo_percent;
+    int64_t		slo_ns;
+    long		burst;
+    double		every;
+    volatile int64_t	burst_at;  // release time of the current burst
+    atomic_int		burst_seq; // set once burst_at is ready
+    double		connect_rate; // new connections per second, 0 for no limit
+    long		connect_max;  // connects in progress at once, 0 for no limit
+    int			notsent_lowat; // TCP_NOTSENT_LOWAT for each socket, 0 to leave as is
     Header		headers;
     Spread		spread;
 
-    atomic_uint_fast64_t	con_cnt;
-    atomic_uint_fast64_t	sent_cnt;
-    atomic_uint_fast64_t	err_cnt;
-    atomic_uint_fast64_t	byte_cnt;
-    atomic_uint_fast8_t		ready_cnt;
+    atomic_long			ready_cnt;
+    struct _stagger		lat; // merged from the pools at the end of a run
+    struct _stagger		send_lag;
+    struct _stagger		con_lat;
+    struct _stagger		blocked; // time sends waited on a full socket buffer
 
     pthread_mutex_t		print_mutex;
+    pthread_t			report_thread;
 } *Perfer;
 
 extern void	perfer_stop(Perfer h);
+extern double	perfer_rate(Perfer p, int64_t at);
 
 #endif /* PERFER_PERFER_H */
@@ -1,64 +1,677 @@
 // Copyright 2016 by Peter Ohler, All Rights Reserved
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #ifdef HAVE_EPOLL
 #include <sys/epoll.h>
+#include <unistd.h>
 #endif
 
+#include "cpu.h"
 #include "dtime.h"
 #include "drop.h"
+#include "mem.h"
 #include "perfer.h"
 #include "pool.h"
 
+// Most connections handed between the polling and receiving threads in one
+// queue operation.
+#define BUF_SLAB	64
+#define BUF_ALIGN	64
+#define MIN_BUF_SIZE	4096
+#define QUEUE_BATCH	64
+
+#ifdef HAVE_URING
+// The top 2 bits of the io_uring user data identify the operation, the next
+// 30 bits the drop generation, and the low 32 bits the drop index.
+#define URING_RECV	1ULL
+#define URING_SEND	2ULL
+#define URING_CONN	3ULL
+#define URING_GEN_MASK	0x3FFFFFFFU
+#define URING_BUF_SIZE	4096
+
+static inline uint64_t
+uring_data(uint64_t op, Pool p, Drop d) {
+    return (op << 62) | ((uint64_t)(d->gen & URING_GEN_MASK) << 32) | (uint64_t)(d - p->drops);
+}
+#endif
+
+// A connection that can take another request is on the ready list which is
+// only touched by the polling thread. Other threads push connections that
+// become ready, such as when a response arrives, onto the wake stack and the
+// polling thread moves them over to the ready list each pass. The ready flag
+// keeps a connection on at most one of the two.
+void
+pool_wake(Pool p, Drop d) {
+    Drop	head;
+
+    if (atomic_flag_test_and_set(&d->ready)) {
+	return;
+    }
+    head = atomic_load(&p->wake);
+    do {
+	d->next = head;
+    } while (!atomic_compare_exchange_weak(&p->wake, &head, d));
+}
+
+// Only the polling thread writes the sending half of a connection. When the
+// receiving thread closes a connection it shuts the socket down, which also
+// wakes the polling thread, and pushes the connection onto the closed stack.
+// The polling thread resets and closes it at the start of its next pass.
+void
+pool_close(Pool p, Drop d) {
+    Drop	head;
+
+    if (atomic_exchange(&d->closing, true)) {
+	return;
+    }
+    if (0 != d->sock) {
+	shutdown(d->sock, SHUT_RDWR);
+    }
+    head = atomic_load(&p->closed);
+    do {
+	d->rnext = head;
+    } while (!atomic_compare_exchange_weak(&p->closed, &head, d));
+}
+
+static void
+pool_reap(Pool p) {
+    Drop	d = atomic_exchange(&p->closed, NULL);
+    Drop	next;
+
+    for (; NULL != d; d = next) {
+	next = d->rnext;
+	drop_closed(d);
+    }
+}
+
+// Buffers are carved from slabs that hold BUF_SLAB of them. A free buffer
+// holds the pointer to the next free one in its first bytes and a slab the
+// pointer to the next slab.
+static long
+buf_stride(Pool p) {
+    return (p->bsize + BUF_ALIGN - 1) & ~(BUF_ALIGN - 1);
+}
+
+static bool
+buf_slab(Pool p) {
+    long	stride = buf_stride(p);
+    char	*slab = (char*)mem_alloc(BUF_ALIGN + stride * BUF_SLAB);
+    char	*buf;
+    int		i;
+
+    if (NULL == slab) {
+	return false;
+    }
+    *(char**)slab = p->slabs;
+    p->slabs = slab;
+    for (i = BUF_SLAB, buf = slab + BUF_ALIGN + stride * (BUF_SLAB - 1); 0 < i; i--, buf -= stride) {
+	*(char**)buf = p->bufs;
+	p->bufs = buf;
+    }
+    return true;
+}
+
+// Called by the receiving thread before the run so the first slab is local
+// to it and is not allocated while latency is being measured.
+static void
+buf_prime(Pool p) {
+    if (NULL == p->bufs) {
+	buf_slab(p);
+    }
+}
+
+char*
+pool_buf_take(Pool p) {
+    char	*buf;
+
+    if (NULL == p->bufs && !buf_slab(p)) {
+	return NULL;
+    }
+    buf = p->bufs;
+    p->bufs = *(char**)buf;
+    p->bused++;
+
+    return buf;
+}
+
+void
+pool_buf_give(Pool p, char *buf) {
+    *(char**)buf = p->bufs;
+    p->bufs = buf;
+    p->bused--;
+}
+
+static void
+buf_free_all(Pool p) {
+    char	*slab;
+
+    while (NULL != (slab = p->slabs)) {
+	p->slabs = *(char**)slab;
+	mem_free(slab, BUF_ALIGN + buf_stride(p) * BUF_SLAB);
+    }
+    p->bufs = NULL;
+    p->bused = 0;
+}
+
+static void
+ready_append(Pool p, Drop d) {
+    d->next = NULL;
+    if (NULL == p->ready_tail) {
+	p->ready = d;
+    } else {
+	p->ready_tail->next = d;
+    }
+    p->ready_tail = d;
+    p->ready_cnt++;
+}
+
+static Drop
+ready_pop(Pool p) {
+    Drop	d = p->ready;
+
+    if (NULL != d) {
+	if (NULL == (p->ready = d->next)) {
+	    p->ready_tail = NULL;
+	}
+	p->ready_cnt--;
+    }
+    return d;
+}
+
+// Moves the woken connections to the end of the ready list in the order they
+// were woken.
+static void
+ready_collect(Pool p) {
+    Drop	d = atomic_exchange(&p->wake, NULL);
+    Drop	prev = NULL;
+    Drop	next;
+
+    for (; NULL != d; d = next) {
+	next = d->next;
+	d->next = prev;
+	prev = d;
+    }
+    for (d = prev; NULL != d; d = next) {
+	next = d->next;
+	ready_append(p, d);
+    }
+}
+
+static bool
+can_send(Pool p, Drop d) {
+    if (atomic_load(&d->closing)) {
+	return false; // ready again once reset
+    }
+    return 0 == d->sock || (!d->connecting && 0 == d->unsent && drop_pending(d) < p->perfer->backlog);
+}
+
+// Puts a connection back on the ready list if it can take another request.
+// Called by the polling thread after sending on a connection taken from the
+// list. The flag is cleared before checking so that a response arriving at
+// the same time either finds it clear and wakes the connection or has
+// already been counted here.
+static void
+ready_check(Pool p, Drop d) {
+    atomic_flag_clear(&d->ready);
+    if (can_send(p, d) && !atomic_flag_test_and_set(&d->ready)) {
+	ready_append(p, d);
+    }
+}
+
+// Adds a connection the polling thread found ready, such as when a connect
+// finishes or the socket buffer drains.
+static void
+ready_add(Pool p, Drop d) {
+    if (can_send(p, d) && !atomic_flag_test_and_set(&d->ready)) {
+	ready_append(p, d);
+    }
+}
+
+// Marks a connection with a new socket or with a change in the events it
+// should be watched for. Each loop updates what it watches for the marked
+// connections before waiting. Polling thread only.
+static void
+pool_changed(Pool p, Drop d) {
+    if (!d->changed) {
+	d->changed = true;
+	d->cnext = p->changed;
+	p->changed = d;
+    }
+}
+
+// Sets the connect limits to a share of the limits for the run. During the
+// run each pool gets its share but the warmup connects the pools one at a
+// time so each gets all of it then.
+static void
+connect_limits(Pool p, double share) {
+    Perfer	perfer = p->perfer;
+
+    p->con_rate = perfer->connect_rate * share;
+    p->con_max = 0;
+    if (0 < perfer->connect_max) {
+	if (1 > (p->con_max = (long)(perfer->connect_max * share))) {
+	    p->con_max = 1;
+	}
+    }
+    // Allow up to 10 milliseconds of connects to be started together.
+    if (1.0 > (p->con_burst = p->con_rate / 100.0)) {
+	p->con_burst = 1.0;
+    }
+    p->con_tokens = p->con_burst;
+    p->con_last = ntime();
+}
+
+// Connects are limited to a rate with a token bucket and to a number in
+// progress at once. Either limit is off when zero.
+static bool
+connect_allowed(Pool p) {
+    if (0 < p->con_max && p->con_max <= p->con_active) {
+	return false;
+    }
+    if (0.0 < p->con_rate) {
+	int64_t	now = ntime();
+
+	p->con_tokens += (double)(now - p->con_last) * p->con_rate / 1000000000.0;
+	p->con_last = now;
+	if (p->con_burst < p->con_tokens) {
+	    p->con_tokens = p->con_burst;
+	}
+	if (p->con_tokens < 1.0) {
+	    return false;
+	}
+    }
+    return true;
+}
+
 static int
-send_check(Perfer p, Drop d) {
-    int	err;
+connect_start(Pool p, Drop d) {
+    p->con_tokens -= 1.0;
+
+    return drop_connect(d);
+}
+
+// The most requests gathered into one write.
+#ifdef IOV_MAX
+#define SEND_IOV	IOV_MAX
+#else
+#define SEND_IOV	1024
+#endif
+
+// Writes cnt requests, picking up where a partial write left off. The
+// requests are gathered into one writev() so a connection with many free
+// pipeline slots fills them with a single system call. Returns the number of
+// requests completely written, which is less than cnt if the socket buffer
+// filled, or -1 if the send failed.
+static int
+send_reqs(Pool pool, Drop d, int cnt) {
+    Perfer		p = pool->perfer;
+    struct iovec	iov[SEND_IOV];
+    int			done = 0;
+
+#ifdef HAVE_URING
+    if (p->use_uring) {
+	// Submitted with the rest of the loop in one system call. The kernel
+	// finishes short sends and the result is checked when each completion
+	// comes back.
+	for (; done < cnt; done++) {
+	    uring_send(&pool->ring, d->sock, p->req_body, p->req_len, uring_data(URING_SEND, pool, d));
+	}
+    }
+#endif
+    while (done < cnt) {
+	int	n = cnt - done;
+	long	want = p->req_len * n - d->woff;
+	ssize_t	scnt;
+
+	if (SEND_IOV < n) {
+	    n = SEND_IOV;
+	    want = p->req_len * n - d->woff;
+	}
+	iov[0].iov_base = p->req_body + d->woff;
+	iov[0].iov_len = p->req_len - d->woff;
+	for (int i = 1; i < n; i++) {
+	    iov[i].iov_base = p->req_body;
+	    iov[i].iov_len = p->req_len;
+	}
+	if (0 > (scnt = writev(d->sock, iov, n))) {
+	    if (EAGAIN == errno || EWOULDBLOCK == errno) {
+		break;
+	    }
+	    tally_add(&pool->poll_tally.sent_cnt, done);
+	    if (atomic_load(&d->closing)) {
+		return -1; // shut down by the receiving thread and reset next pass
+	    }
+	    if (p->keep_alive) {
+		if (!p->json) {
+		    printf("*-*-* error sending request: %s - %ld\n", strerror(errno), (long)scnt);
+		}
+		tally_add(&pool->poll_tally.err_cnt, 1);
+		drop_cleanup(d);
+	    }
+	    return -1;
+	}
+	// A request cut off by a full socket buffer is finished by the next
+	// write.
+	done += (int)((scnt + d->woff) / p->req_len);
+	d->woff = (scnt + d->woff) % p->req_len;
+	if (scnt < want) {
+	    break;
+	}
+    }
+    tally_add(&pool->poll_tally.sent_cnt, done);
+    if (0 < done && 0 == d->start_time) {
+	d->start_time = ntime();
+    }
+    if (done < cnt) {
+	// Backpressure, not a failure. The rest is written once the socket is
+	// writable again.
+	if (0 == d->blocked_at) {
+	    d->blocked_at = ntime();
+	}
+    } else if (0 != d->blocked_at) {
+	stagger_add(&pool->blocked, ntime() - d->blocked_at);
+	d->blocked_at = 0;
+    }
+    return done;
+}
 
+static void
+pipeline_push(Drop d, int64_t at) {
+    int	tail = atomic_load(&d->ptail);
+
+    atomic_fetch_add(&d->pool->inflight, 1);
+    atomic_store(&d->pipeline[tail], at);
+    tail++;
+    if (d->psize <= tail) {
+	tail = 0;
+    }
+    atomic_store(&d->ptail, tail);
+}
+
+// Writes the requests waiting in the pipeline until they are all out or the
+// socket buffer fills again. Latency is still measured from the time each
+// was put in the pipeline.
+static void
+send_unsent(Pool pool, Drop d) {
+    int		tail = atomic_load(&d->ptail) - d->unsent;
+    int		sent;
+    int64_t	now;
+
+    if (tail < 0) {
+	tail += d->psize;
+    }
+    if (0 < d->unsent) {
+	if (0 > (sent = send_reqs(pool, d, d->unsent))) {
+	    if (0 != d->sock && !atomic_load(&d->closing)) {
+		drop_cleanup(d);
+	    }
+	    return;
+	}
+	now = ntime();
+	for (; 0 < sent; sent--) {
+	    int64_t	at = atomic_load(&d->pipeline[tail]);
+
+	    stagger_add(&pool->send_lag, now < at ? 0 : now - at);
+	    d->unsent--;
+	    if (d->psize <= ++tail) {
+		tail = 0;
+	    }
+	}
+	if (0 < d->unsent) {
+	    return;
+	}
+    }
+    pool_changed(pool, d); // no longer waiting to write
+    ready_add(pool, d);
+}
+
+// Sends up to cnt requests, as many as the backlog has room for, in one
+// write. If intended is not zero it is the time the requests should have been
+// sent when metering or bursting. Latency is then measured from the intended
+// time so a stalled server is not hidden by requests waiting to go out. The
+// difference between the intended and actual send time is tracked as the
+// send lag.
+static int
+send_check(Pool pool, Drop d, int64_t intended, int cnt) {
+    Perfer	p = pool->perfer;
+    int		err;
+
+    if (atomic_load(&d->closing)) {
+	return 0;
+    }
     if (0 == d->sock) {
-	if (0 != (err = drop_connect(d))) {
+	if (!connect_allowed(pool)) {
+	    return 0;
+	}
+	if (0 != (err = connect_start(pool, d))) {
 	    // Failed to connect. Abort the test.
 	    perfer_stop(p);
 	    return err;
 	}
+	pool_changed(pool, d);
+    }
+    if (p->backlog - drop_pending(d) < cnt) {
+	cnt = p->backlog - drop_pending(d);
     }
-    if (drop_pending(d) < p->backlog) {
-	int	scnt = send(d->sock, p->req_body, p->req_len, 0);
+    if (0 < cnt) {
+	int64_t	now;
+	int	sent;
+	int	i;
 
-	if (p->req_len != scnt) {
-	    if (p->keep_alive) {
-		if (!p->json) {
-		    printf("*-*-* error sending request: %s - %d\n", strerror(errno), scnt);
+	if (d->connecting || 0 < d->unsent) {
+	    // Metered requests wait in the pipeline for the connect to finish
+	    // or for room in the socket buffer so the wait counts toward the
+	    // latency.
+	    if (0 < intended) {
+		for (i = cnt; 0 < i; i--) {
+		    pipeline_push(d, intended);
 		}
-		atomic_fetch_add(&p->err_cnt, 1);
-		drop_cleanup(d);
+		d->unsent += cnt;
 	    }
 	    return 0;
 	}
-	if (0 == d->start_time) {
-	    d->start_time = ntime();
+	now = ntime();
+	if (0 > (sent = send_reqs(pool, d, cnt))) {
+	    return 0;
+	}
+	if (0 < sent) {
+	    int64_t	at = ntime();
+
+	    if (0 < intended) {
+		for (i = sent; 0 < i; i--) {
+		    stagger_add(&pool->send_lag, at < intended ? 0 : at - intended);
+		}
+		at = intended;
+	    }
+	    for (i = sent; 0 < i; i--) {
+		pipeline_push(d, at);
+	    }
 	}
-	atomic_fetch_add(&p->sent_cnt, 1);
+	if (sent < cnt) {
+	    // The rest follow the written ones in the pipeline and go out
+	    // when there is room in the socket buffer.
+	    for (i = cnt - sent; 0 < i; i--) {
+		pipeline_push(d, 0 < intended ? intended : now);
+	    }
+	    d->unsent += cnt - sent;
+	    pool_changed(pool, d); // watch for room to write
+	}
+    }
+    return 0;
+}
+
+// Finishes a connect that was in progress and sends the requests that were
+// waiting on it. Returns non-zero and stops the run if the connect failed.
+static int
+connect_done(Pool pool, Drop d) {
+    int	err;
+
+    if (0 != (err = drop_connected(d))) {
+	perfer_stop(pool->perfer);
+	return err;
+    }
+    send_unsent(pool, d);
+
+    return 0;
+}
 
-	int	tail = atomic_load(&d->ptail);
+// Fills the free pipeline slots of each connection that can take another
+// request. Connections that become ready during the pass wait for the next
+// one.
+static int
+ready_send(Pool p) {
+    Drop	d;
+    int		err;
 
-	atomic_store(&d->pipeline[tail], ntime());
-	tail++;
-	if (PIPELINE_SIZE <= tail) {
-	    tail = 0;
+    ready_collect(p);
+    for (long n = p->ready_cnt; 0 < n; n--) {
+	d = ready_pop(p);
+	if (0 != (err = send_check(p, d, 0, p->perfer->backlog))) {
+	    return err;
 	}
-	atomic_store(&d->ptail, tail);
+	ready_check(p, d);
     }
     return 0;
 }
 
-int
-pool_send(Pool p, int i) {
-    return send_check(p->perfer, p->drops + (i % p->dcnt));
+// When the rate is changing the schedule moves forward in steps of this many
+// nanoseconds.
+#define RATE_STEP	1000000LL
+
+// Moves next_send forward until the owed requests worth of rate have passed
+// or until next_send is past the horizon. If the rate is changing the rate is
+// integrated in small steps so a ramp starting at zero is paced correctly.
+static void
+schedule(Pool p, int64_t horizon) {
+    Perfer	pr = p->perfer;
+    double	rate;
+    double	dt;
+
+    while (0.0 < p->owed && p->next_send <= horizon) {
+	rate = perfer_rate(pr, p->next_send) * p->share;
+	if (rate <= 0.0) {
+	    p->next_send += RATE_STEP; // nothing is owed while the rate is zero
+	    continue;
+	}
+	dt = p->owed / rate * 1000000000.0;
+	if (NULL == pr->profile.segs || dt <= (double)RATE_STEP) {
+	    p->next_send += (int64_t)dt;
+	    p->owed = 0.0;
+	    break;
+	}
+	p->next_send += RATE_STEP;
+	p->owed -= rate * (double)RATE_STEP / 1000000000.0;
+    }
+}
+
+// Sends the metered requests that are due. The pool gets a share of the meter
+// rate in proportion to its connections and keeps its own schedule. If all the
+// connections are busy the intended time is left as is so the wait is
+// included in the latency once the request is sent. The timeout is set to the
+// number of milliseconds until the next request is due.
+static int
+meter_check(Pool p, int *timeout) {
+    Perfer	pr = p->perfer;
+    int64_t	now = ntime();
+    Drop	d;
+    int		err;
+
+    if (pr->paused) {
+	// Start fresh when the pause ends so nothing is owed for the pause.
+	p->next_send = now;
+	p->owed = 0.0;
+	*timeout = 1;
+	return 0;
+    }
+    while (p->next_send <= now) {
+	int	n;
+
+	if (0.0 < p->owed) { // next_send is only a step along the way
+	    schedule(p, now);
+	    continue;
+	}
+	ready_collect(p);
+	for (n = p->ready_cnt; 0 < n; n--) {
+	    d = ready_pop(p);
+	    if (0 == d->sock && !connect_allowed(p)) {
+		ready_append(p, d); // still ready, just not yet
+		continue;
+	    }
+	    if (0 != (err = send_check(p, d, p->next_send, 1))) {
+		return err;
+	    }
+	    ready_check(p, d);
+	    break;
+	}
+	if (0 == n) { // all busy
+	    *timeout = pr->poll_timeout;
+	    return 0;
+	}
+	p->owed = arrival_units(&p->arrival);
+	schedule(p, now);
+    }
+    *timeout = (int)((p->next_send - now) / 1000000LL);
+    if (0 < pr->poll_timeout && pr->poll_timeout < *timeout) {
+	*timeout = pr->poll_timeout;
+    }
+    return 0;
+}
+
+// Release the pool share of a burst at the release time. Every pool spins on
+// the same release time so they start sending within a few microseconds of
+// each other. Requests are spread over all the connections in all the pools
+// so the first connections get one extra if the burst does not divide evenly.
+static int
+burst_check(Pool p, int *timeout) {
+    Perfer	pr = p->perfer;
+    int		seq = atomic_load(&pr->burst_seq);
+    int64_t	at;
+    int64_t	now;
+    long	base = pr->burst / pr->ccnt;
+    long	rem = pr->burst % pr->ccnt;
+    Drop	d;
+    int		i;
+    int		err;
+
+    *timeout = 1;
+    if (seq == p->burst_seq) {
+	return 0;
+    }
+    p->burst_seq = seq;
+    at = pr->burst_at;
+    while ((now = ntime()) < at) {
+	if (100000 < at - now) {
+	    nwait(at - now - 100000);
+	}
+    }
+    p->burst_first = now;
+    for (d = p->drops, i = 0; i < p->dcnt; i++, d++) {
+	long	cnt = base + ((p->first + i < rem) ? 1 : 0);
+
+	if (0 < cnt && 0 != (err = send_check(p, d, at, (int)cnt))) {
+	    return err;
+	}
+    }
+    p->burst_sent = seq;
+
+    return 0;
+}
+
+// Picks up the latency stagger selected by pool_rotate() and lets it know
+// the other one is no longer in use. Called by whichever thread receives.
+static void
+lat_check(Pool p) {
+    int	cur = atomic_load_explicit(&p->lat_cur, memory_order_acquire);
+
+    p->cur_lat = p->lat + cur;
+    atomic_store_explicit(&p->lat_seen, cur, memory_order_release);
 }
 
 static void*
@@ -68,84 +681,180 @@ poll_loop(void *x) {
     int			dcnt = p->dcnt;
     struct pollfd	ps[dcnt];
     struct pollfd	*pp;
+    Drop		batch[QUEUE_BATCH];
+    int			bcnt = 0;
     Drop		d;
+    Drop		next;
     int			i;
+    int			cnt;
     int			pt = pr->poll_timeout;
     bool		go = false;
 
+    // Each connection has a fixed slot that is only updated when the
+    // connection changes. Slots without a socket are ignored by poll().
+    for (d = p->drops, i = dcnt, pp = ps; 0 < i; i--, d++, pp++) {
+	pp->fd = -1;
+	pp->events = 0;
+	pp->revents = 0;
+	pool_changed(p, d);
+	ready_add(p, d);
+    }
+    if (pr->inline_recv) {
+	buf_prime(p);
+    }
     atomic_fetch_add(&pr->ready_cnt, 1);
     while (!pr->done) {
 	if (!go) {
 	    if (pr->go) {
 		go = true;
+		p->next_send = ntime();
+		p->owed = 0.0;
 	    } else {
 		dsleep(0.001);
 		continue;
 	    }
 	}
-	if (pr->enough) {
-	    bool	done = true;
-
-	    for (d = p->drops, i = dcnt, pp = ps; 0 < i; i--, d++) {
-		if (0 < drop_pending(d)) {
-		    done = false;
-		    break;
-		}
-	    }
-	    if (done) {
-		pr->done = true;
-		for (d = p->drops, i = dcnt, pp = ps; 0 < i; i--, d++) {
-		    drop_cleanup(d);
-		}
-		break;
+	pool_reap(p);
+	if (pr->enough && 0 >= atomic_load(&p->inflight)) {
+	    pr->done = true;
+	    for (d = p->drops, i = dcnt; 0 < i; i--, d++) {
+		drop_cleanup(d);
 	    }
+	    break;
 	}
-	for (d = p->drops, i = dcnt, pp = ps; 0 < i; i--, d++) {
-	    if (!pr->enough && 0 == pr->meter) {
-		if (0 != send_check(pr, d)) {
-		    p->poll_finished = true;
-		    return NULL;
-		}
-	    }
-	    if (0 < d->sock) {
+	pt = pr->poll_timeout;
+	if (!pr->enough && pr->metered && 0 != meter_check(p, &pt)) {
+	    p->poll_finished = true;
+	    return NULL;
+	}
+	if (!pr->enough && 0 < pr->burst && 0 != burst_check(p, &pt)) {
+	    p->poll_finished = true;
+	    return NULL;
+	}
+	if (!pr->enough && pr->saturate && 0 != ready_send(p)) {
+	    p->poll_finished = true;
+	    return NULL;
+	}
+	for (d = p->changed, p->changed = NULL; NULL != d; d = next) {
+	    next = d->cnext;
+	    d->changed = false;
+	    pp = ps + (d - p->drops);
+	    if (0 == d->sock) {
+		pp->fd = -1;
+	    } else {
 		pp->fd = d->sock;
-		d->pp = pp;
-		pp->events = POLLERR | POLLIN;
-		pp->revents = 0;
-		pp++;
+		if (d->connecting) {
+		    pp->events = POLLOUT;
+		} else if (0 < d->unsent) {
+		    pp->events = POLLERR | POLLIN | POLLOUT;
+		} else {
+		    pp->events = POLLERR | POLLIN;
+		}
 	    }
 	}
-	if (0 > (i = poll(ps, pp - ps, pt))) {
+	if (pr->inline_recv) {
+	    lat_check(p);
+	}
+	if (0 > (cnt = poll(ps, dcnt, pt))) {
 	    if (EAGAIN == errno) {
 		continue;
 	    }
 	    printf("*-*-* polling error: %s\n", strerror(errno));
 	    break;
 	}
-	if (0 == i) {
-	    continue;
-	}
-	for (d = p->drops, i = dcnt; 0 < i; i--, d++) {
-	    if (NULL == d->pp || 0 == d->pp->revents || 0 == d->sock) {
+	// Stop looking once all the ready slots have been seen.
+	for (d = p->drops, pp = ps; 0 < cnt; d++, pp++) {
+	    if (0 == pp->revents) {
 		continue;
 	    }
-	    if (0 != (d->pp->revents & POLLERR)) {
-		atomic_fetch_add(&pr->err_cnt, 1);
+	    cnt--;
+	    if (atomic_load(&d->closing)) {
+		continue; // reset at the start of the next pass
+	    }
+	    if (pp->fd != d->sock) {
+		// Closed by the receiving thread since the slot was set.
+		if (0 == d->sock) {
+		    pp->fd = -1;
+		}
+		continue;
+	    }
+	    if (d->connecting) {
+		if (0 != connect_done(p, d)) {
+		    p->poll_finished = true;
+		    return NULL;
+		}
+		continue;
+	    }
+	    if (0 != (pp->revents & POLLERR)) {
+		tally_add(&p->poll_tally.err_cnt, 1);
 		drop_cleanup(d);
+		pp->fd = -1;
+		continue;
 	    }
-	    if (0 != (d->pp->revents & POLLIN)) {
-		if (!atomic_flag_test_and_set(&d->queued)) {
+	    if (0 != (pp->revents & POLLOUT) && 0 < d->unsent) {
+		send_unsent(p, d);
+	    }
+	    if (0 != (pp->revents & POLLIN)) {
+		if (pr->inline_recv) {
+		    atomic_store(&d->recv_time, ntime());
+		    drop_recv(d);
+		    if (!pr->enough && pr->saturate && 0 != send_check(p, d, 0, pr->backlog)) {
+			p->poll_finished = true;
+			return NULL;
+		    }
+		} else if (!atomic_flag_test_and_set(&d->queued)) {
 		    atomic_store(&d->recv_time, ntime());
-		    queue_push(&p->q, d);
+		    batch[bcnt++] = d;
+		    if (QUEUE_BATCH <= bcnt) {
+			queue_push_batch(&p->q, batch, bcnt);
+			bcnt = 0;
+		    }
 		}
 	    }
 	}
+	if (0 < bcnt) {
+	    queue_push_batch(&p->q, batch, bcnt);
+	    bcnt = 0;
+	}
+	if (!pr->inline_recv) {
+	    queue_wake(&p->q);
+	}
     }
     p->poll_finished = true;
 
     return NULL;
 }
 #ifdef HAVE_EPOLL
+// Registers a new socket or changes the events a socket is watched for. A
+// connecting socket is watched for writing to learn when the connect is
+// done, as is a socket with requests waiting on a full socket buffer.
+static void
+epoll_watch(int efd, Drop d) {
+    struct epoll_event	event = {
+	.events = EPOLLIN,
+	.data = {
+	    .ptr = d,
+	},
+    };
+    if (0 == d->sock) {
+	return; // closed sockets leave epoll on their own
+    }
+    if (d->connecting) {
+	event.events = EPOLLOUT;
+    } else if (0 < d->unsent) {
+	event.events = EPOLLIN | EPOLLOUT;
+    }
+    if (d->wsock == d->sock && d->wevents == event.events) {
+	return;
+    }
+    if (0 > epoll_ctl(efd, d->wsock == d->sock ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, d->sock, &event)) {
+	printf("*-*-* failed to add epoll: %s\n", strerror(errno));
+	return;
+    }
+    d->wsock = d->sock;
+    d->wevents = event.events;
+}
+
 static void*
 epoll_loop(void *x) {
     Pool		p = (Pool)x;
@@ -153,7 +862,10 @@ epoll_loop(void *x) {
     int			dcnt = p->dcnt;
     struct epoll_event	events[dcnt];
     struct epoll_event	*ep;
+    Drop		batch[QUEUE_BATCH];
+    int			bcnt = 0;
     Drop		d;
+    Drop		next;
     int			i;
     int			cnt;
     int			pt = pr->poll_timeout;
@@ -162,140 +874,439 @@ epoll_loop(void *x) {
 
     if (0 > (efd = epoll_create(1))) {
 	printf("*-*-* failed to create epoll: %s\n", strerror(errno));
+	p->poll_finished = true;
 	return NULL;
     }
-    for (d = p->drops, i = dcnt, ep = events; 0 < i; i--, d++) {
-	struct epoll_event	event = {
-	    .events = EPOLLIN,
-	    .data = {
-		.ptr = d,
-	    },
-	};
-	if (0 > epoll_ctl(efd, EPOLL_CTL_ADD, d->sock, &event)) {
-	    printf("*-*-* failed to add epoll: %s\n", strerror(errno));
-	}
+    for (d = p->drops, i = dcnt; 0 < i; i--, d++) {
+	pool_changed(p, d);
+	ready_add(p, d);
+    }
+    if (pr->inline_recv) {
+	buf_prime(p);
     }
     atomic_fetch_add(&pr->ready_cnt, 1);
     while (!pr->done) {
 	if (!go) {
 	    if (pr->go) {
 		go = true;
+		p->next_send = ntime();
+		p->owed = 0.0;
 	    } else {
 		dsleep(0.001);
 		continue;
 	    }
 	}
-	if (pr->enough) {
-	    bool	done = true;
-
+	pool_reap(p);
+	if (pr->enough && 0 >= atomic_load(&p->inflight)) {
+	    pr->done = true;
 	    for (d = p->drops, i = dcnt; 0 < i; i--, d++) {
-		if (0 < drop_pending(d)) {
-		    done = false;
-		    break;
-		}
-	    }
-	    if (done) {
-		pr->done = true;
-		for (d = p->drops, i = dcnt; 0 < i; i--, d++) {
-		    drop_cleanup(d);
-		}
-		break;
+		drop_cleanup(d);
 	    }
+	    break;
 	}
-	for (d = p->drops, i = dcnt; 0 < i; i--, d++) {
-	    if (!pr->enough && 0 == pr->meter) {
-		if (0 != send_check(pr, d)) {
-		    return NULL;
-		}
-	    }
+	pt = pr->poll_timeout;
+	if (!pr->enough && pr->metered && 0 != meter_check(p, &pt)) {
+	    p->poll_finished = true;
+	    return NULL;
+	}
+	if (!pr->enough && 0 < pr->burst && 0 != burst_check(p, &pt)) {
+	    p->poll_finished = true;
+	    return NULL;
+	}
+	if (!pr->enough && pr->saturate && 0 != ready_send(p)) {
+	    p->poll_finished = true;
+	    return NULL;
+	}
+	for (d = p->changed, p->changed = NULL; NULL != d; d = next) {
+	    next = d->cnext;
+	    d->changed = false;
+	    epoll_watch(efd, d);
+	}
+	if (pr->inline_recv) {
+	    lat_check(p);
 	}
 	if (0 > (cnt = epoll_wait(efd, events, sizeof(events) / sizeof(*events), pt))) {
 	    printf("*-*-* epool wait fails: %s\n", strerror(errno));
 	    perfer_stop(pr);
+	    p->poll_finished = true;
 	    return NULL;
 	}
 	for (ep = events; 0 < cnt; ep++, cnt--) {
 	    d = (Drop)ep->data.ptr;
+	    if (0 == d->sock || atomic_load(&d->closing)) {
+		continue;
+	    }
+	    if (d->connecting) {
+		if (0 != connect_done(p, d)) {
+		    p->poll_finished = true;
+		    return NULL;
+		}
+		continue;
+	    }
+	    if (0 != (ep->events & EPOLLOUT) && 0 < d->unsent) {
+		send_unsent(p, d);
+	    }
 	    if (0 != (ep->events & EPOLLIN)) {
-		if (!atomic_flag_test_and_set(&d->queued)) {
+		if (pr->inline_recv) {
+		    atomic_store(&d->recv_time, ntime());
+		    drop_recv(d);
+		    if (!pr->enough && pr->saturate && 0 != send_check(p, d, 0, pr->backlog)) {
+			p->poll_finished = true;
+			return NULL;
+		    }
+		} else if (!atomic_flag_test_and_set(&d->queued)) {
 		    atomic_store(&d->recv_time, ntime());
-		    queue_push(&p->q, d);
+		    batch[bcnt++] = d;
+		    if (QUEUE_BATCH <= bcnt) {
+			queue_push_batch(&p->q, batch, bcnt);
+			bcnt = 0;
+		    }
 		}
 	    }
 	}
+	if (0 < bcnt) {
+	    queue_push_batch(&p->q, batch, bcnt);
+	    bcnt = 0;
+	}
+	if (!pr->inline_recv) {
+	    queue_wake(&p->q);
+	}
     }
+    close(efd);
+    p->poll_finished = true;
+
     return NULL;
 }
 #endif
 
+#ifdef HAVE_URING
+static unsigned
+pow2_clamp(long n, unsigned min, unsigned max) {
+    unsigned	size = min;
+
+    while (size < n && size < max) {
+	size *= 2;
+    }
+    return size;
+}
+
+static void
+uring_complete(Pool p, struct io_uring_cqe *cqe, int64_t now) {
+    uint64_t	ud = cqe->user_data;
+    Drop	d;
+    bool	current;
+
+    if (0 == ud) { // cancel
+	return;
+    }
+    d = p->drops + (ud & 0xFFFFFFFFULL);
+    current = (((ud >> 32) & URING_GEN_MASK) == (d->gen & URING_GEN_MASK));
+    switch (ud >> 62) {
+    case URING_SEND:
+	if (current && p->perfer->req_len != cqe->res) {
+	    if (!p->perfer->json) {
+		printf("*-*-* error sending request: %s - %d\n", strerror(0 > cqe->res ? -cqe->res : EIO), cqe->res);
+	    }
+	    tally_add(&p->poll_tally.err_cnt, 1);
+	    drop_cleanup(d);
+	}
+	break;
+    case URING_RECV:
+	if (0 != (cqe->flags & IORING_CQE_F_BUFFER)) {
+	    unsigned	id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+	    if (current && 0 < cqe->res) {
+		drop_received(d, uring_buf(&p->ring, id), cqe->res, now);
+	    }
+	    uring_buf_return(&p->ring, id);
+	}
+	if (!current) {
+	    break;
+	}
+	if (0 == (cqe->flags & IORING_CQE_F_MORE)) {
+	    d->armed = false; // armed again on the next pass if still open
+	    pool_changed(p, d);
+	}
+	if (0 == cqe->res || (0 > cqe->res && -ENOBUFS != cqe->res)) {
+	    // Closed by the server or failed.
+	    if (0 < drop_pending(d)) {
+		tally_add(&p->recv_tally.err_cnt, 1);
+	    }
+	    drop_cleanup(d);
+	}
+	break;
+    case URING_CONN:
+	if (current) {
+	    d->armed = false;
+	    if (0 == connect_done(p, d)) {
+		pool_changed(p, d); // arm the receive
+	    }
+	}
+	break;
+    default:
+	break;
+    }
+}
+
+// Polls, receives, and sends on one thread with io_uring. Sends are queued
+// as they are due and submitted in one batch each pass along with any new
+// receives. Each connection has a multishot receive that fills buffers from
+// a provided buffer ring so there is no system call per receive.
+static void*
+uring_loop(void *x) {
+    Pool		p = (Pool)x;
+    Perfer		pr = p->perfer;
+    int			dcnt = p->dcnt;
+    struct io_uring_cqe	*cqe;
+    Drop		d;
+    Drop		next;
+    int			i;
+    int			err;
+    int			pt;
+    int64_t		now;
+    bool		go = false;
+
+    if (0 != (err = uring_init(&p->ring, pow2_clamp(dcnt * 2, 64, 4096), pow2_clamp(dcnt * 2, 64, 32768), URING_BUF_SIZE))) {
+	printf("*-*-* failed to set up io_uring: %s\n", strerror(err));
+	uring_cleanup(&p->ring);
+	p->poll_finished = true;
+	return NULL;
+    }
+    uring_register_send(&p->ring, pr->req_body, pr->req_len);
+    for (d = p->drops, i = dcnt; 0 < i; i--, d++) {
+	pool_changed(p, d);
+	ready_add(p, d);
+    }
+    if (pr->inline_recv) {
+	buf_prime(p);
+    }
+    atomic_fetch_add(&pr->ready_cnt, 1);
+    while (!pr->done) {
+	if (!go) {
+	    if (pr->go) {
+		go = true;
+		p->next_send = ntime();
+		p->owed = 0.0;
+	    } else {
+		dsleep(0.001);
+		continue;
+	    }
+	}
+	if (pr->enough && 0 >= atomic_load(&p->inflight)) {
+	    pr->done = true;
+	    break; // connections are closed below
+	}
+	pt = pr->poll_timeout;
+	if (!pr->enough && pr->metered && 0 != meter_check(p, &pt)) {
+	    break;
+	}
+	if (!pr->enough && 0 < pr->burst && 0 != burst_check(p, &pt)) {
+	    break;
+	}
+	if (!pr->enough && pr->saturate && 0 != ready_send(p)) {
+	    break;
+	}
+	// A connecting socket gets a poll to learn when the connect is done
+	// and a connected one a multishot receive.
+	for (d = p->changed, p->changed = NULL; NULL != d; d = next) {
+	    next = d->cnext;
+	    d->changed = false;
+	    if (d->armed || 0 == d->sock) {
+		continue;
+	    }
+	    if (d->connecting) {
+		uring_poll_add(&p->ring, d->sock, POLLOUT, uring_data(URING_CONN, p, d));
+	    } else {
+		uring_recv_multishot(&p->ring, d->sock, uring_data(URING_RECV, p, d));
+	    }
+	    d->armed = true;
+	}
+	lat_check(p);
+	if (0 != (err = uring_submit_wait(&p->ring, pt))) {
+	    printf("*-*-* io_uring wait failed: %s\n", strerror(-err));
+	    perfer_stop(pr);
+	    break;
+	}
+	now = ntime();
+	while (NULL != (cqe = uring_peek(&p->ring))) {
+	    uring_complete(p, cqe, now);
+	    uring_seen(&p->ring);
+	}
+    }
+    for (d = p->drops, i = dcnt; 0 < i; i--, d++) {
+	drop_cleanup(d);
+    }
+    uring_cleanup(&p->ring);
+    p->poll_finished = true;
+
+    return NULL;
+}
+#endif
+
+// Takes all the connections the polling thread has queued, up to a batch at
+// a time, and receives on each.
 static void*
 recv_loop(void *x) {
     Pool	p = (Pool)x;
     Perfer	pr = p->perfer;
+    Drop	batch[QUEUE_BATCH];
     Drop	d;
+    int		cnt;
 
+    buf_prime(p);
     atomic_fetch_add(&pr->ready_cnt, 1);
     while (!pr->done) {
-	if (NULL == (d = queue_pop(&p->q, 0.01))) {
-	    continue;
+	lat_check(p);
+	cnt = queue_pop_batch(&p->q, batch, QUEUE_BATCH, 0.01);
+	for (int i = 0; i < cnt; i++) {
+	    d = batch[i];
+	    drop_recv(d);
+	    atomic_flag_clear(&d->queued);
 	}
-	drop_recv(d);
-	atomic_flag_clear(&d->queued);
     }
     p->recv_finished = true;
 
     return NULL;
 }
 
-int
-pool_init(Pool p, Perfer perfer, int dcnt) {
+// Pipeline slots in a cache line.
+#define PIPE_LINE	(CACHE_LINE / (int)sizeof(atime))
+
+static size_t
+pipes_size(Pool p) {
+    return sizeof(atime) * p->psize * p->dcnt;
+}
+
+// Allocates the connections, pipelines, queue, and latency histograms of a
+// pool. The mapped memory is faulted in as it is allocated so it is placed
+// with the allocating thread and the run does not start with page faults.
+static void*
+alloc_pool(void *x) {
+    Pool	p = (Pool)x;
+    Perfer	perfer = p->perfer;
+    long	dcnt = p->dcnt;
     int		err;
     int		i;
     Drop	d;
 
-    p->recv_finished = false;
-    p->poll_finished = false;
-    p->perfer = perfer;
-    p->dcnt = dcnt;
-    if (NULL == (p->drops = (Drop)calloc(dcnt, sizeof(struct _drop)))) {
+    // Mapped memory is page aligned so each connection starts on a cache
+    // line.
+    if (NULL == (p->drops = (Drop)mem_alloc(dcnt * sizeof(struct _drop)))) {
 	printf("*-*-* Not enough memory for connections.\n");
-	return ENOMEM;
+	return (void*)(intptr_t)ENOMEM;
     }
-    for (d = p->drops, i = p->dcnt; 0 < i; i--, d++) {
-	// TBD pass in response size after a probe to the target
-	drop_init(d, p);
+    // A ring holds one more than the backlog so full and empty differ and is
+    // rounded up to whole cache lines so no two connections share a line.
+    p->psize = perfer->backlog + 1;
+    p->psize = (p->psize + PIPE_LINE - 1) / PIPE_LINE * PIPE_LINE;
+    if (NULL == (p->pipes = (atime*)mem_alloc(pipes_size(p)))) {
+	printf("*-*-* Not enough memory for connection pipelines.\n");
+	return (void*)(intptr_t)ENOMEM;
+    }
+    for (d = p->drops, i = 0; i < p->dcnt; i++, d++) {
+	drop_init(d, p, p->pipes + i * p->psize, p->psize);
     }
     if (0 != (err = queue_init(&p->q, dcnt + 4))) {
 	printf("*-*-* Not enough memory for connection queue.\n");
+	return (void*)(intptr_t)err;
+    }
+    if (0 != (err = stagger_init(p->lat, perfer->digits)) ||
+	0 != (err = stagger_init(p->lat + 1, perfer->digits)) ||
+	0 != (err = stagger_init(&p->send_lag, perfer->digits)) ||
+	0 != (err = stagger_init(&p->con_lat, perfer->digits)) ||
+	0 != (err = stagger_init(&p->blocked, perfer->digits))) {
+	printf("*-*-* Not enough memory for latency tracking.\n");
+	return (void*)(intptr_t)err;
+    }
+    return NULL;
+}
+
+int
+pool_init(Pool p, Perfer perfer, int index, int dcnt) {
+    pthread_t	t;
+    void	*ret;
+    int		err;
+
+    p->recv_finished = false;
+    p->poll_finished = false;
+    memset(&p->poll_tally, 0, sizeof(p->poll_tally));
+    memset(&p->recv_tally, 0, sizeof(p->recv_tally));
+    p->perfer = perfer;
+    p->dcnt = dcnt;
+    p->share = (double)dcnt / (double)perfer->ccnt;
+    p->next_send = 0;
+    p->owed = 0.0;
+    atomic_init(&p->inflight, 0);
+    p->ready = NULL;
+    p->ready_tail = NULL;
+    p->ready_cnt = 0;
+    atomic_init(&p->wake, NULL);
+    atomic_init(&p->closed, NULL);
+    p->changed = NULL;
+    p->first = 0;
+    p->burst_seq = 0;
+    p->burst_sent = 0;
+    p->burst_first = 0;
+    p->con_active = 0;
+    connect_limits(p, p->share);
+    p->bufs = NULL;
+    p->slabs = NULL;
+    p->bsize = MAX_RESP_SIZE; // until the warmup shows what is needed
+    p->bused = 0;
+    arrival_init(&p->arrival, perfer->arrival, perfer->seed + index);
+    p->cur_lat = p->lat;
+    atomic_init(&p->lat_cur, 0);
+    atomic_init(&p->lat_seen, 0);
+    // With two CPUs for each pool the polling and receiving threads each
+    // get their own, otherwise they share one.
+    p->poll_cpu = -1;
+    p->recv_cpu = -1;
+    if (0 < perfer->cpu_cnt) {
+	if (!perfer->inline_recv && perfer->tcnt * 2 <= perfer->cpu_cnt) {
+	    p->poll_cpu = perfer->cpus[index * 2];
+	    p->recv_cpu = perfer->cpus[index * 2 + 1];
+	} else {
+	    p->poll_cpu = perfer->cpus[index];
+	    p->recv_cpu = p->poll_cpu;
+	}
+    }
+    // The memory used in the run is allocated and faulted in on a thread
+    // started for the pool instead of on the main thread. It runs on the
+    // CPU of the polling thread so the memory is on the same node.
+    if (0 != (err = cpu_thread(&t, alloc_pool, p, p->poll_cpu, false))) {
+	printf("*-*-* Failed to create allocation thread. %s\n", strerror(err));
 	return err;
     }
-    return 0;
+    pthread_join(t, &ret);
+
+    return (int)(intptr_t)ret;
 }
 
 int
 pool_start(Pool p) {
-    bool	use_epoll = p->perfer->keep_alive && p->perfer->use_epoll;
+    Perfer	pr = p->perfer;
+    void	*(*loop)(void*) = poll_loop;
+    int		err;
 
-#ifndef HAVE_EPOLL
-    use_epoll = false;
-#endif
-    if (0 != pthread_create(&p->recv_thread, NULL, recv_loop, p)) {
-	printf("*-*-* Failed to create receiving thread. %s\n", strerror(errno));
-	return errno;
+    if (!pr->inline_recv) {
+	if (0 != (err = cpu_thread(&p->recv_thread, recv_loop, p, p->recv_cpu, pr->fifo))) {
+	    printf("*-*-* Failed to create receiving thread. %s\n", strerror(err));
+	    return err;
+	}
     }
-    dsleep(0.5);
-    if (use_epoll) {
 #ifdef HAVE_EPOLL
-	if (0 != pthread_create(&p->poll_thread, NULL, epoll_loop, p)) {
-	    printf("*-*-* Failed to create polling thread. %s\n", strerror(errno));
-	    return errno;
-	}
+    if (pr->keep_alive && pr->use_epoll) {
+	loop = epoll_loop;
+    }
 #endif
-    } else {
-	if (0 != pthread_create(&p->poll_thread, NULL, poll_loop, p)) {
-	    printf("*-*-* Failed to create polling thread. %s\n", strerror(errno));
-	    return errno;
-	}
+#ifdef HAVE_URING
+    if (pr->use_uring) {
+	loop = uring_loop;
+    }
+#endif
+    if (0 != (err = cpu_thread(&p->poll_thread, loop, p, p->poll_cpu, pr->fifo))) {
+	printf("*-*-* Failed to create polling thread. %s\n", strerror(err));
+	return err;
     }
     return 0;
 }
@@ -304,7 +1315,11 @@ void
 pool_wait(Pool p) {
     // Wait for thread to finish. Join is not used as we want to kill the thread
     // if it does not exit correctly.
-    pthread_detach(p->recv_thread); // cleanup thread resources when completed
+    if (p->perfer->inline_recv) {
+	p->recv_finished = true; // there is no receiving thread
+    } else {
+	pthread_detach(p->recv_thread); // cleanup thread resources when completed
+    }
     pthread_detach(p->poll_thread); // cleanup thread resources when completed
     if (!p->recv_finished || !p->poll_finished) {
 	double  late = dtime() + p->perfer->duration + 2.0;
@@ -312,11 +1327,55 @@ pool_wait(Pool p) {
 	while ((!p->recv_finished || !p->poll_finished) && dtime() < late) {
 	    dsleep(0.1);
         }
-	pthread_cancel(p->recv_thread);
+	if (!p->perfer->inline_recv) {
+	    pthread_cancel(p->recv_thread);
+	}
 	pthread_cancel(p->poll_thread);
     }
 }
 
+// Number of requests sent that have not been answered.
+long
+pool_pending(Pool p) {
+    return atomic_load(&p->inflight);
+}
+
+// Adds the pool counters to the tally provided. Only called after the pool
+// threads have finished.
+void
+pool_tally(Pool p, Tally t) {
+    Tally	src[] = { &p->poll_tally, &p->recv_tally, NULL };
+
+    for (Tally *tp = src; NULL != *tp; tp++) {
+	tally_add(&t->con_cnt, atomic_load_explicit(&(*tp)->con_cnt, memory_order_relaxed));
+	tally_add(&t->sent_cnt, atomic_load_explicit(&(*tp)->sent_cnt, memory_order_relaxed));
+	tally_add(&t->err_cnt, atomic_load_explicit(&(*tp)->err_cnt, memory_order_relaxed));
+	tally_add(&t->byte_cnt, atomic_load_explicit(&(*tp)->byte_cnt, memory_order_relaxed));
+    }
+}
+
+// Switches the receiving thread over to the other latency stagger, waits for
+// it to stop using the current one, and then moves the samples collected
+// into s. Only one thread should call this at a time.
+void
+pool_rotate(Pool p, Stagger s) {
+    int		old = atomic_load(&p->lat_cur);
+    int		cur = 1 - old;
+    double	giveup = dtime() + 1.0;
+
+    atomic_store_explicit(&p->lat_cur, cur, memory_order_release);
+    while (cur != atomic_load_explicit(&p->lat_seen, memory_order_acquire) && !p->recv_finished) {
+	if (giveup < dtime()) {
+	    // The receiving thread is stuck so leave the samples for the next
+	    // rotation or the final merge.
+	    return;
+	}
+	dsleep(0.0001);
+    }
+    stagger_merge(s, p->lat + old);
+    stagger_reset(p->lat + old);
+}
+
 void
 pool_cleanup(Pool p) {
     Drop	d;
@@ -326,7 +1385,94 @@ pool_cleanup(Pool p) {
 	drop_cleanup(d);
     }
     queue_cleanup(&p->q);
+    stagger_cleanup(p->lat);
+    stagger_cleanup(p->lat + 1);
+    stagger_cleanup(&p->send_lag);
+    stagger_cleanup(&p->blocked);
+    stagger_cleanup(&p->con_lat);
     free(p->xbuf);
+    for (d = p->drops, i = p->dcnt; 0 < i; i--, d++) {
+	d->buf = NULL;
+    }
+    buf_free_all(p);
+    if (NULL != p->pipes) {
+	mem_free(p->pipes, pipes_size(p));
+	p->pipes = NULL;
+    }
+}
+
+// Opens all the connections before the run. Connects are started as fast as
+// the limits allow and finished in any order so a large number of
+// connections do not wait on each other.
+static int
+connect_all(Pool p) {
+    struct pollfd	*ps;
+    Drop		*ds;
+    Drop		d = p->drops;
+    Drop		end = p->drops + p->dcnt;
+    long		n = 0;
+    long		i;
+    long		j;
+    int			err = 0;
+    double		giveup = dtime() + 2.0;
+
+    if (NULL == (ps = (struct pollfd*)malloc(sizeof(struct pollfd) * p->dcnt)) ||
+	NULL == (ds = (Drop*)malloc(sizeof(Drop) * p->dcnt))) {
+	free(ps);
+	printf("*-*-* Not enough memory for connections.\n");
+	return ENOMEM;
+    }
+    while (d < end || 0 < n) {
+	for (; d < end && connect_allowed(p); d++) {
+	    if (0 != (err = connect_start(p, d))) {
+		goto DONE;
+	    }
+	    if (d->connecting) {
+		ps[n].fd = d->sock;
+		ps[n].events = POLLOUT;
+		ds[n] = d;
+		n++;
+	    }
+	    giveup = dtime() + 2.0;
+	}
+	if (0 == n) { // waiting on the connect rate
+	    dsleep(0.001);
+	    continue;
+	}
+	if (giveup < dtime()) {
+	    printf("*-*-* timed out connecting\n");
+	    err = ETIMEDOUT;
+	    goto DONE;
+	}
+	for (i = 0; i < n; i++) {
+	    ps[i].revents = 0;
+	}
+	if (0 > poll(ps, n, 10)) {
+	    if (EAGAIN == errno || EINTR == errno) {
+		continue;
+	    }
+	    err = errno;
+	    printf("*-*-* polling error: %s\n", strerror(err));
+	    goto DONE;
+	}
+	for (i = 0, j = 0; i < n; i++) {
+	    if (0 == ps[i].revents) {
+		ps[j] = ps[i];
+		ds[j] = ds[i];
+		j++;
+	    } else if (0 != (err = drop_connected(ds[i]))) {
+		goto DONE;
+	    } else {
+		giveup = dtime() + 2.0;
+	    }
+	}
+	n = j;
+    }
+DONE:
+    free(ps);
+    free(ds);
+
+    return err;
 }
 
 int
@@ -337,9 +1483,14 @@ pool_warmup(Pool p) {
 
     p->xsize = 0;
     // Initialize connections before starting the benchmarks.
+    connect_limits(p, 1.0);
+    err = connect_all(p);
+    connect_limits(p, p->share);
+    if (0 != err) {
+	return err;
+    }
     for (d = p->drops, i = p->dcnt; 0 < i; i--, d++) {
-	if (0 != (err = drop_connect(d)) ||
-	    0 != (err = drop_warmup_send(d))) {
+	if (0 != (err = drop_warmup_send(d))) {
 	    return err;
 	}
     }
@@ -348,16 +1499,33 @@ pool_warmup(Pool p) {
 	    return err;
 	}
 	if (0 == p->xsize) {
-	    p->xsize = d->xsize;
-	    p->xbuf = (char*)malloc(p->xsize + 1);
-	    memcpy(p->xbuf, d->buf, p->xsize);
-	    p->xbuf[p->xsize] = '\0';
+	    // A response too large to hold in the buffer is -1 and is never
+	    // compared.
+	    if (0 < (p->xsize = d->xsize)) {
+		p->xbuf = (char*)malloc(p->xsize + 1);
+		memcpy(p->xbuf, d->buf, p->xsize);
+		p->xbuf[p->xsize] = '\0';
+	    }
 	} else if (p->xsize != d->xsize) {
 	    p->xsize = -1;
 	    free(p->xbuf);
 	    p->xbuf = NULL;
 	}
 	d->xsize = 0;
+	pool_buf_give(p, d->buf);
+	d->buf = NULL;
+    }
+    // A buffer holds what one read returns, up to a full pipeline of the
+    // responses seen in the warmup. Only the headers of a larger response
+    // need to fit as bodies are not kept.
+    if (0 == p->bused) {
+	buf_free_all(p);
+	if (0 < p->xsize && (long)p->xsize * p->psize < MAX_RESP_SIZE) {
+	    p->bsize = (long)p->xsize * p->psize;
+	    if (p->bsize < MIN_BUF_SIZE) {
+		p->bsize = MIN_BUF_SIZE;
+	    }
+	}
     }
     return 0;
 }
@@ -4,34 +4,115 @@
 #define PERFER_POOL_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+#include "arrival.h"
 #include "queue.h"
+#include "stagger.h"
+#include "uring.h"
 
 struct _perfer;
 struct _drop;
 
+// Counters are written by only one thread, either the polling thread or the
+// receiving thread, so no read-modify-write atomics are needed. They are
+// padded to a cache line to keep the two threads from sharing.
+typedef struct _tally {
+    atomic_uint_fast64_t	con_cnt;
+    atomic_uint_fast64_t	sent_cnt;
+    atomic_uint_fast64_t	err_cnt;
+    atomic_uint_fast64_t	byte_cnt;
+    char			pad[32];
+} *Tally;
+
+// Only the owning thread writes a tally so a relaxed load and store is enough
+// to let the reporting thread read the counts while a run is in progress.
+static inline void
+tally_add(atomic_uint_fast64_t *cnt, uint64_t n) {
+    atomic_store_explicit(cnt, atomic_load_explicit(cnt, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
 typedef struct _pool {
     struct _perfer	*perfer;
     volatile bool	recv_finished;
     volatile bool	poll_finished;
 
+    struct _tally	poll_tally; // polling and sending
+    struct _stagger	send_lag;   // only written by the sending thread
+    struct _stagger	blocked;    // send stalls on a full socket buffer
+    double		share;      // fraction of the meter rate for the pool
+    struct _arrival	arrival;
+    int64_t		next_send;  // intended time of the next metered request
+    double		owed;       // requests of rate to pass before next_send is due
+    long		first;      // index of the first connection over all pools
+    int			burst_seq;
+    volatile int	burst_sent;  // sequence of the last burst fully sent
+    volatile int64_t	burst_first; // time the last burst started sending
+    long		con_max;    // connects allowed in progress, 0 for no limit
+    long		con_active; // connects in progress
+    double		con_rate;   // connects per second, 0 for no limit
+    double		con_tokens; // connects that can be started now
+    double		con_burst;  // most tokens that can be saved up
+    int64_t		con_last;   // when tokens were last added
+    struct _stagger	con_lat;    // time to connect, only written by the polling thread
+    atomic_long		inflight;   // requests sent and not answered over all connections
+
+    // Connections are kept on lists by state so the loops only visit the
+    // ones that need attention. See pool_wake().
+    struct _drop	*ready;     // can take another request, polling thread only
+    struct _drop	*ready_tail;
+    long		ready_cnt;
+    _Atomic(struct _drop*)	wake; // woken by any thread, moved to ready each pass
+    struct _drop	*changed;   // socket or wanted events changed, polling thread only
+    _Atomic(struct _drop*)	closed; // closed by the receiving thread, reset by the polling thread
+
+    // Receive buffers are only held by connections with bytes of a response
+    // waiting to be parsed. They are handed out and taken back by the
+    // receiving thread alone so no locking is needed.
+    char		*bufs;  // free receive buffers
+    char		*slabs; // blocks the buffers are carved from
+    long		bsize;  // size of each receive buffer
+    long		bused;  // buffers held by connections
+
     struct _queue	q;
     struct _drop	*drops;
     long		dcnt;
+    atomic_int_fast64_t	*pipes; // pipeline rings of the connections
+    int			psize;  // slots in each ring
     int			xsize;
     char		*xbuf;
     pthread_t		poll_thread;
     pthread_t		recv_thread;
+    int			poll_cpu; // CPU the polling thread is pinned to or -1
+    int			recv_cpu; // CPU the receiving thread is pinned to or -1
+#ifdef HAVE_URING
+    struct _uring	ring; // only used by the polling thread
+#endif
+    // The receiving thread records latency in lat[lat_cur] and sets lat_seen
+    // to the index it is using before each receive. The other is drained by
+    // the reporting thread for interval reports.
+    struct _stagger	lat[2];
+    Stagger		cur_lat;
+    atomic_int		lat_cur;
+    atomic_int		lat_seen;
+    struct _tally	recv_tally;
 } *Pool;
 
 struct _perfer;
 
-extern int	pool_init(Pool p, struct _perfer *perfer, int dcnt);
+extern int	pool_init(Pool p, struct _perfer *perfer, int index, int dcnt);
 extern int	pool_start(Pool p);
 extern void	pool_wait(Pool p);
 extern void	pool_cleanup(Pool p);
 extern int	pool_warmup(Pool p);
-extern int	pool_send(Pool p, int i);
+extern long	pool_pending(Pool p);
+extern void	pool_tally(Pool p, Tally t);
+extern void	pool_rotate(Pool p, Stagger s);
+extern void	pool_wake(Pool p, struct _drop *d);
+extern void	pool_close(Pool p, struct _drop *d);
+extern char*	pool_buf_take(Pool p);
+extern void	pool_buf_give(Pool p, char *buf);
 
 #endif /* PERFER_POOL_H */
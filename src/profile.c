@@ -0,0 +1,175 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+// A profile file has one segment per line. Blank lines and lines starting
+// with a # are ignored. Rates are in requests per second and times are in
+// seconds.
+//
+//   step <rate> <seconds>
+//   ramp <from-rate> <to-rate> <seconds>
+//   sine <mean-rate> <amplitude> <period> <seconds>
+
+static int
+read_nums(char *s, double *nums, int max) {
+    char	*end;
+    int		cnt = 0;
+
+    for (; cnt < max; cnt++) {
+	for (; ' ' == *s || '\t' == *s; s++) {
+	}
+	if ('\0' == *s || '\n' == *s || '#' == *s) {
+	    break;
+	}
+	nums[cnt] = strtod(s, &end);
+	if (end == s || nums[cnt] < 0.0) {
+	    return -1;
+	}
+	s = end;
+    }
+    for (; isspace(*s); s++) {
+    }
+    if ('\0' != *s && '#' != *s) {
+	return -1;
+    }
+    return cnt;
+}
+
+int
+profile_load(Profile p, const char *path) {
+    FILE	*f = fopen(path, "r");
+    char	line[1024];
+    char	*s;
+    int		lcnt = 0;
+    Segment	tail = NULL;
+    Segment	seg;
+    double	nums[4];
+    int		ncnt;
+
+    p->segs = NULL;
+    p->duration = 0.0;
+    if (NULL == f) {
+	printf("*-*-* Failed to open '%s'. %s\n", path, strerror(errno));
+	return errno;
+    }
+    while (NULL != fgets(line, sizeof(line), f)) {
+	lcnt++;
+	for (s = line; isspace(*s); s++) {
+	}
+	if ('\0' == *s || '#' == *s) {
+	    continue;
+	}
+	if (NULL == (seg = (Segment)calloc(1, sizeof(struct _segment)))) {
+	    printf("*-*-* Out of memory.\n");
+	    fclose(f);
+	    return ENOMEM;
+	}
+	if (NULL == tail) {
+	    p->segs = seg;
+	} else {
+	    tail->next = seg;
+	}
+	tail = seg;
+	seg->start = p->duration;
+	if (0 == strncasecmp("step", s, 4)) {
+	    ncnt = read_nums(s + 4, nums, 2);
+	    seg->kind = SEG_STEP;
+	    seg->from = nums[0];
+	    seg->to = nums[0];
+	    seg->secs = nums[1];
+	    ncnt -= 2;
+	} else if (0 == strncasecmp("ramp", s, 4)) {
+	    ncnt = read_nums(s + 4, nums, 3);
+	    seg->kind = SEG_RAMP;
+	    seg->from = nums[0];
+	    seg->to = nums[1];
+	    seg->secs = nums[2];
+	    ncnt -= 3;
+	} else if (0 == strncasecmp("sine", s, 4)) {
+	    ncnt = read_nums(s + 4, nums, 4);
+	    seg->kind = SEG_SINE;
+	    seg->from = nums[0];
+	    seg->to = nums[1];
+	    seg->period = nums[2];
+	    seg->secs = nums[3];
+	    ncnt -= 4;
+	    if (0 == ncnt && 0.0 >= seg->period) {
+		ncnt = -1;
+	    }
+	} else {
+	    ncnt = -1;
+	}
+	if (0 != ncnt || 0.0 >= seg->secs) {
+	    printf("*-*-* Invalid load profile segment on line %d of '%s'.\n", lcnt, path);
+	    fclose(f);
+	    profile_cleanup(p);
+	    return EINVAL;
+	}
+	p->duration += seg->secs;
+    }
+    fclose(f);
+    if (NULL == p->segs) {
+	printf("*-*-* No segments in load profile '%s'.\n", path);
+	return EINVAL;
+    }
+    return 0;
+}
+
+void
+profile_cleanup(Profile p) {
+    Segment	seg;
+
+    while (NULL != (seg = p->segs)) {
+	p->segs = seg->next;
+	free(seg);
+    }
+    p->duration = 0.0;
+}
+
+// Target rate at the number of seconds from the start of the run. After the
+// last segment the rate is zero.
+double
+profile_rate(Profile p, double elapsed) {
+    for (Segment seg = p->segs; NULL != seg; seg = seg->next) {
+	double	dt = elapsed - seg->start;
+
+	if (dt < 0.0 || seg->secs <= dt) {
+	    continue;
+	}
+	switch (seg->kind) {
+	case SEG_RAMP:
+	    return seg->from + (seg->to - seg->from) * dt / seg->secs;
+	case SEG_SINE: {
+	    double	rate = seg->from + seg->to * sin(2.0 * M_PI * dt / seg->period);
+
+	    return rate < 0.0 ? 0.0 : rate;
+	}
+	case SEG_STEP:
+	default:
+	    return seg->from;
+	}
+    }
+    return 0.0;
+}
+
+// Mean target rate between two times.
+double
+profile_mean(Profile p, double from, double to) {
+    double	sum = 0.0;
+    double	step = (to - from) / 100.0;
+
+    if (step <= 0.0) {
+	return profile_rate(p, from);
+    }
+    for (int i = 0; i < 100; i++) {
+	sum += profile_rate(p, from + step * (i + 0.5));
+    }
+    return sum / 100.0;
+}
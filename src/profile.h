@@ -0,0 +1,34 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#ifndef PERFER_PROFILE_H
+#define PERFER_PROFILE_H
+
+typedef enum {
+    SEG_STEP	= 0,
+    SEG_RAMP	= 1,
+    SEG_SINE	= 2,
+} SegKind;
+
+// A segment of a load profile. Segments follow one after the other starting
+// at the beginning of the run.
+typedef struct _segment {
+    struct _segment	*next;
+    SegKind		kind;
+    double		start;  // seconds from the start of the run
+    double		secs;
+    double		from;   // rate at the start or mean rate for sine
+    double		to;     // rate at the end or amplitude for sine
+    double		period; // sine only
+} *Segment;
+
+typedef struct _profile {
+    Segment	segs;
+    double	duration;
+} *Profile;
+
+extern int	profile_load(Profile p, const char *path);
+extern void	profile_cleanup(Profile p);
+extern double	profile_rate(Profile p, double elapsed);
+extern double	profile_mean(Profile p, double from, double to);
+
+#endif /* PERFER_PROFILE_H */
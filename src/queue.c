@@ -3,6 +3,12 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 
 #include "dtime.h"
 #include "queue.h"
@@ -12,112 +18,258 @@
 //#define RETRY_SECS	0.00001
 #define RETRY_SECS	0.0001
 
-// head and tail both increment and wrap.
-// tail points to next open space.
-// When head == tail the queue is full. This happens when tail catches up with head.
-//
+// Spin limits for a pop waiting on an empty queue. The spin doubles when an
+// item shows up while spinning and halves when the pop has to park so an
+// idle queue does not burn CPU.
+#define MIN_SPIN	16
+#define MAX_SPIN	8192
+
+// head and tail are positions that only increase and are masked to find the
+// slot. A slot is free for a push at position pos when its seq is pos and
+// filled for a pop at pos when its seq is pos + 1. A pop frees the slot for
+// the next lap by setting seq to pos + size. A batch claims a run of slots
+// with a single compare and swap of the head or tail.
 
 int
 queue_init(Queue q, size_t qsize) {
-    if (qsize < 4) {
-	qsize = 4;
+    size_t	size = 4;
+
+    while (size < qsize) {
+	size *= 2;
     }
-    if (NULL == (q->q = (Drop*)calloc(qsize, sizeof(Drop)))) {
+    if (NULL == (q->slots = (Slot)calloc(size, sizeof(struct _slot)))) {
 	return ENOMEM;
     }
-    q->end = q->q + qsize;
-
-    atomic_init(&q->head, q->q);
-    atomic_init(&q->tail, q->q + 1);
-    atomic_flag_clear(&q->push_lock);
-    atomic_flag_clear(&q->pop_lock);
+    q->mask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+	atomic_init(&q->slots[i].seq, i);
+    }
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->seq, 0);
+    atomic_init(&q->waiting, 0);
+    q->spin = MIN_SPIN;
 
     return 0;
 }
 
 void
 queue_cleanup(Queue q) {
-    free(q->q);
-    q->q = NULL;
-    q->end = NULL;
+    free(q->slots);
+    q->slots = NULL;
 }
 
-void
-queue_push(Queue q, Drop item) {
-    Drop	*tail;
+// Claims up to cnt free slots at the tail and fills them. Returns the number
+// pushed which is zero only if the queue is full.
+static int
+put(Queue q, Drop *items, int cnt) {
+    size_t	pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    Slot	s;
+    int		n;
 
-    while (atomic_flag_test_and_set(&q->push_lock)) {
-	dsleep(RETRY_SECS);
+    while (true) {
+	for (n = 0; n < cnt; n++) {
+	    s = q->slots + ((pos + n) & q->mask);
+	    if (atomic_load_explicit(&s->seq, memory_order_acquire) != pos + n) {
+		break;
+	    }
+	}
+	if (0 == n) {
+	    size_t	tail = atomic_load(&q->tail);
+
+	    if (tail == pos) {
+		return 0;
+	    }
+	    pos = tail;
+	    continue;
+	}
+	if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + n, memory_order_relaxed, memory_order_relaxed)) {
+	    break;
+	}
     }
-    // Wait for head to move on.
-    while (atomic_load(&q->head) == atomic_load(&q->tail)) {
-	dsleep(RETRY_SECS);
+    for (int i = 0; i < n; i++) {
+	s = q->slots + ((pos + i) & q->mask);
+	s->item = items[i];
+	atomic_store_explicit(&s->seq, pos + i + 1, memory_order_release);
     }
-    *(Drop*)atomic_load(&q->tail) = item;
-    tail = (Drop*)atomic_load(&q->tail) + 1;
+    return n;
+}
+
+// Claims up to max filled slots at the head and empties them. Returns the
+// number taken.
+static int
+take(Queue q, Drop *out, int max) {
+    size_t	pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    Slot	s;
+    int		n;
+
+    while (true) {
+	for (n = 0; n < max; n++) {
+	    s = q->slots + ((pos + n) & q->mask);
+	    if (atomic_load_explicit(&s->seq, memory_order_acquire) != pos + n + 1) {
+		break;
+	    }
+	}
+	if (0 == n) {
+	    size_t	head = atomic_load(&q->head);
 
-    if (q->end <= tail) {
-	tail = q->q;
+	    if (head == pos) {
+		return 0;
+	    }
+	    pos = head;
+	    continue;
+	}
+	if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + n, memory_order_relaxed, memory_order_relaxed)) {
+	    break;
+	}
+    }
+    for (int i = 0; i < n; i++) {
+	s = q->slots + ((pos + i) & q->mask);
+	out[i] = s->item;
+	atomic_store_explicit(&s->seq, pos + i + q->mask + 1, memory_order_release);
     }
-    atomic_store(&q->tail, tail);
-    atomic_flag_clear(&q->push_lock);
+    return n;
 }
 
-Drop
-queue_pop(Queue q, double timeout) {
-    Drop	item;
-    Drop	*next;
-    int 	cnt;
+// True if the slot at the head has been filled.
+static bool
+filled(Queue q) {
+    size_t	pos = atomic_load(&q->head);
 
-    while (atomic_flag_test_and_set(&q->pop_lock)) {
-	dsleep(RETRY_SECS);
-    }
-    item = *(Drop*)atomic_load(&q->head);
+    return atomic_load_explicit(&q->slots[pos & q->mask].seq, memory_order_acquire) == pos + 1;
+}
 
-    if (NULL != item) {
-	*(Drop*)atomic_load(&q->head) = NULL;
-	atomic_flag_clear(&q->pop_lock);
+static inline void
+relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
 
-	return item;
+// Waits for an item to be pushed. Spins first in case one is about to be
+// pushed and then parks until a push wakes it or giveup passes. Returns false
+// on timeout.
+static bool
+wait_push(Queue q, int64_t giveup) {
+    for (int i = q->spin; 0 < i; i--) {
+	if (filled(q)) {
+	    if (q->spin < MAX_SPIN) {
+		q->spin *= 2;
+	    }
+	    return true;
+	}
+	relax();
     }
-    next = (Drop*)atomic_load(&q->head) + 1;
+    if (MIN_SPIN < q->spin) {
+	q->spin /= 2;
+    }
+#ifdef __linux__
+    while (true) {
+	unsigned	seq = atomic_load(&q->seq);
+	int64_t		now;
 
-    if (q->end <= next) {
-	next = q->q;
+	// Raising waiting and then checking the slot pairs with a push that
+	// fills the slot and then checks waiting in queue_wake(). A full
+	// fence on each side keeps either from reading before its own write
+	// so at least one sees the other: the wake bumps seq or the check
+	// finds the slot filled. The seq read before raising waiting makes
+	// the futex wait return at once if the bump comes after the check.
+	atomic_fetch_add(&q->waiting, 1);
+	atomic_thread_fence(memory_order_seq_cst);
+	if (filled(q)) {
+	    atomic_fetch_sub(&q->waiting, 1);
+	    return true;
+	}
+	if (giveup <= (now = ntime())) {
+	    atomic_fetch_sub(&q->waiting, 1);
+	    return false;
+	}
+	struct timespec	ts = {
+	    .tv_sec = (giveup - now) / 1000000000LL,
+	    .tv_nsec = (giveup - now) % 1000000000LL,
+	};
+	syscall(SYS_futex, &q->seq, FUTEX_WAIT_PRIVATE, seq, &ts, NULL, 0);
+	atomic_fetch_sub(&q->waiting, 1);
     }
-    // If the next is the tail then wait for something to be appended.
-    for (cnt = (int)(timeout / RETRY_SECS); atomic_load(&q->tail) == next; cnt--) {
-	if (cnt <= 0) {
-	    atomic_flag_clear(&q->pop_lock);
-	    return NULL;
+#else
+    while (!filled(q)) {
+	if (giveup <= ntime()) {
+	    return false;
 	}
 	dsleep(RETRY_SECS);
     }
-    atomic_store(&q->head, next);
-    item = *next;
-    *next = NULL;
-    atomic_flag_clear(&q->pop_lock);
+    return true;
+#endif
+}
 
-    return item;
+void
+queue_push(Queue q, Drop item) {
+    queue_push_batch(q, &item, 1);
 }
 
-bool
-queue_empty(Queue q) {
-    Drop	*head = atomic_load(&q->head);
-    Drop	*next = head + 1;
+// Pushes all the items, waiting for room if the queue is full.
+void
+queue_push_batch(Queue q, Drop *items, int cnt) {
+    int	n;
+
+    while (0 < cnt) {
+	if (0 == (n = put(q, items, cnt))) {
+	    dsleep(RETRY_SECS);
+	    continue;
+	}
+	items += n;
+	cnt -= n;
+    }
+}
+
+// Wakes a pop parked on the queue. Pushes do not wake on their own so a
+// batch of pushes costs at most one wakeup. Call after the last push.
+void
+queue_wake(Queue q) {
+#ifdef __linux__
+    // The slots were filled with release stores which may otherwise be
+    // passed by the load of waiting. See wait_push().
+    atomic_thread_fence(memory_order_seq_cst);
+    if (0 < atomic_load(&q->waiting)) {
+	atomic_fetch_add(&q->seq, 1);
+	syscall(SYS_futex, &q->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+#endif
+}
 
-    if (q->end <= next) {
-	next = q->q;
+Drop
+queue_pop(Queue q, double timeout) {
+    Drop	item;
+
+    if (0 == queue_pop_batch(q, &item, 1, timeout)) {
+	return NULL;
     }
-    if (NULL == *head && atomic_load(&q->tail) == next) {
-	return true;
+    return item;
+}
+
+// Pops up to max items into out, waiting up to timeout seconds if the queue
+// is empty. Returns the number popped.
+int
+queue_pop_batch(Queue q, Drop *out, int max, double timeout) {
+    int64_t	giveup = ntime() + (int64_t)(timeout * 1000000000.0);
+    int		n;
+
+    while (0 == (n = take(q, out, max))) {
+	if (!wait_push(q, giveup)) {
+	    return 0;
+	}
     }
-    return false;
+    return n;
+}
+
+bool
+queue_empty(Queue q) {
+    return atomic_load(&q->head) == atomic_load(&q->tail);
 }
 
 int
 queue_count(Queue q) {
-    int	size = (int)(q->end - q->q);
-
-    return ((Drop*)atomic_load(&q->tail) - (Drop*)atomic_load(&q->head) + size) % size;
+    return (int)(atomic_load(&q->tail) - atomic_load(&q->head));
 }
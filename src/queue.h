@@ -5,26 +5,44 @@
 
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 #include "err.h"
 
 struct _drop;
 
+// Each slot carries a sequence number that tells pushers and pops whether it
+// is free or filled for the current lap around the ring.
+typedef struct _slot {
+    atomic_size_t	seq;
+    struct _drop	*item;
+} *Slot;
+
+// A bounded lock-free ring that any number of threads can push to and pop
+// from. The head and tail are on their own cache lines so pushers and pops
+// do not share.
 typedef struct _queue {
-    struct _drop		**q;
-    struct _drop		**end;
-    _Atomic(struct _drop**)	head;
-    _Atomic(struct _drop**)	tail;
-    atomic_flag			push_lock; // set to true when push in progress
-    atomic_flag			pop_lock; // set to true when push in progress
+    Slot		slots;
+    size_t		mask;
+    int			spin;    // pop spins before parking, adjusted by the popper
+    char		pad0[64];
+    atomic_size_t	tail;    // next position to push
+    char		pad1[64];
+    atomic_size_t	head;    // next position to pop
+    atomic_int		waiting; // number of pops parked on seq
+    char		pad2[64];
+    atomic_uint		seq;     // futex word bumped to wake a waiting pop
 } *Queue;
 
 extern int		queue_init(Queue q, size_t qsize);
 extern void		queue_cleanup(Queue q);
 
 extern void		queue_push(Queue q, struct _drop *item);
+extern void		queue_push_batch(Queue q, struct _drop **items, int cnt);
+extern void		queue_wake(Queue q);
 extern struct _drop*	queue_pop(Queue q, double timeout);
+extern int		queue_pop_batch(Queue q, struct _drop **out, int max, double timeout);
 extern bool		queue_empty(Queue q);
 extern int		queue_count(Queue q);
 
@@ -0,0 +1,429 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#include <limits.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define RESP_SIMD 1
+#endif
+
+#include "resp.h"
+
+typedef enum {
+    RS_VERSION	= 0,
+    RS_CODE,
+    RS_SKIP,	// rest of the line is ignored
+    RS_NAME_START,
+    RS_NAME,
+    RS_CLEN,
+    RS_CLEN_TAIL,
+    RS_TENC,
+    // The rest are for the body once the headers are complete.
+    RS_BODY,		// Content-Length bytes
+    RS_CHUNK_SIZE,
+    RS_CHUNK_EXT,	// chunk extensions are ignored
+    RS_CHUNK_DATA,
+    RS_CHUNK_END,	// CRLF after the chunk data
+    RS_TRAILER_START,
+    RS_TRAILER,
+    RS_DONE,
+} State;
+
+#define NAME_CLEN	0x01
+#define NAME_TENC	0x02
+
+static const char	clen_name[] = "content-length";
+static const char	tenc_name[] = "transfer-encoding";
+static const char	chunked[] = "chunked";
+
+static inline int
+lower(int c) {
+    return ('A' <= c && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static const unsigned char*
+find_nl_scalar(const unsigned char *b, const unsigned char *end) {
+    const unsigned char	*nl = memchr(b, '\n', end - b);
+
+    return (NULL == nl) ? end : nl;
+}
+
+#ifdef RESP_SIMD
+
+// Header lines are mostly shorter than a library call is worth so the line
+// ends are found inline, 16 or 32 bytes at a time.
+static const unsigned char*
+find_nl_sse(const unsigned char *b, const unsigned char *end) {
+    const __m128i	nl = _mm_set1_epi8('\n');
+    int			mask;
+
+    for (; 16 <= end - b; b += 16) {
+	if (0 != (mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)b), nl)))) {
+	    return b + __builtin_ctz(mask);
+	}
+    }
+    return find_nl_scalar(b, end);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char*
+find_nl_avx2(const unsigned char *b, const unsigned char *end) {
+    const __m256i	nl = _mm256_set1_epi8('\n');
+    unsigned int	mask;
+
+    for (; 32 <= end - b; b += 32) {
+	if (0 != (mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)b), nl)))) {
+	    return b + __builtin_ctz(mask);
+	}
+    }
+    return find_nl_sse(b, end);
+}
+
+// The names with the colon, lower case, and the bits to fold to lower case
+// for just the letters so other bytes such as a \r never match a '-'.
+static const char	clen_match[16] = "content-length:";
+static const char	tenc_match[16] = "transfer-encodin";
+static const char	clen_fold[16] = {
+    0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00,
+    0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, 0x00 };
+static const char	tenc_fold[16] = {
+    0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+    0x00, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20 };
+
+// Matches a whole header name with its colon against the two names of
+// interest at once. At least sizeof(tenc_name) + 1 bytes must be readable.
+static int
+match_name(const unsigned char *b) {
+    __m128i	v = _mm_loadu_si128((const __m128i*)b);
+    int		clen = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(v, _mm_loadu_si128((const __m128i*)clen_fold)),
+							  _mm_loadu_si128((const __m128i*)clen_match)));
+    int		tenc = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(v, _mm_loadu_si128((const __m128i*)tenc_fold)),
+							  _mm_loadu_si128((const __m128i*)tenc_match)));
+
+    if (0x7FFF == (clen & 0x7FFF)) {
+	return NAME_CLEN;
+    }
+    if (0xFFFF == tenc && 'g' == lower(b[16]) && ':' == b[17]) {
+	return NAME_TENC;
+    }
+    return 0;
+}
+
+#endif
+
+static const unsigned char*	(*find_nl)(const unsigned char *b, const unsigned char *end) =
+#ifdef RESP_SIMD
+    find_nl_sse;
+#else
+    find_nl_scalar;
+#endif
+
+void
+resp_init(void) {
+#ifdef RESP_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+	find_nl = find_nl_avx2;
+    }
+#endif
+}
+
+void
+resp_reset(Resp r) {
+    r->off = 0;
+    r->hsize = 0;
+    r->clen = -1;
+    r->status = 0;
+    r->left = 0;
+    r->chunked = false;
+    r->done = false;
+    r->state = RS_VERSION;
+    r->names = 0;
+    r->npos = 0;
+    r->vpos = 0;
+}
+
+// Informational, no content, and not modified responses never have a body.
+static bool
+has_body(Resp r) {
+    return 200 <= r->status && 204 != r->status && 304 != r->status;
+}
+
+static long
+resp_size(Resp r) {
+    if (r->chunked || r->clen < 0 || !has_body(r)) {
+	return r->hsize;
+    }
+    return r->hsize + r->clen;
+}
+
+// Scans the bytes of buf from where the last call stopped up to len. Returns
+// the size of the response once the headers are complete, 0 if more bytes
+// are needed, or -1 if the response is malformed. The size of a chunked
+// response is only the headers as the body length is not known from them.
+long
+resp_parse(Resp r, const char *buf, long len) {
+    const unsigned char	*b = (const unsigned char*)buf + r->off;
+    const unsigned char	*end = (const unsigned char*)buf + len;
+    int			c;
+
+    if (RS_BODY <= r->state) {
+	return resp_size(r);
+    }
+    for (; b < end; b++) {
+	c = *b;
+	switch (r->state) {
+	case RS_VERSION:
+	    if (' ' == c) {
+		r->state = RS_CODE;
+	    } else if ('\n' == c) {
+		return -1;
+	    }
+	    break;
+	case RS_CODE:
+	    if ('0' <= c && c <= '9') {
+		if (1000 <= (r->status = r->status * 10 + c - '0')) {
+		    return -1;
+		}
+	    } else if ('\n' == c) {
+		r->state = RS_NAME_START;
+	    } else {
+		r->state = RS_SKIP;
+	    }
+	    break;
+	case RS_SKIP:
+	    if (end == (b = find_nl(b, end))) {
+		r->off = len;
+		return 0;
+	    }
+	    r->state = RS_NAME_START;
+	    break;
+	case RS_NAME_START:
+	    if ('\r' == c) {
+		break;
+	    }
+	    if ('\n' == c) {
+		r->hsize = (const char*)b - buf + 1;
+		r->off = r->hsize;
+		if (r->chunked && has_body(r)) {
+		    r->vpos = 0;
+		    r->state = RS_CHUNK_SIZE;
+		} else if (r->hsize < resp_size(r)) {
+		    r->left = r->clen;
+		    r->state = RS_BODY;
+		} else {
+		    r->done = true;
+		    r->state = RS_DONE;
+		}
+		return resp_size(r);
+	    }
+#ifdef RESP_SIMD
+	    // With the whole name in the buffer there is no need to go byte by
+	    // byte. Any other header is skipped to the end of the line.
+	    if ((long)sizeof(tenc_name) <= end - b) {
+		r->vpos = 0;
+		switch (match_name(b)) {
+		case NAME_CLEN:
+		    b += sizeof(clen_name) - 1;
+		    r->clen = 0;
+		    r->state = RS_CLEN;
+		    break;
+		case NAME_TENC:
+		    b += sizeof(tenc_name) - 1;
+		    r->state = RS_TENC;
+		    break;
+		default:
+		    r->state = RS_SKIP;
+		    break;
+		}
+		break;
+	    }
+#endif
+	    r->names = NAME_CLEN | NAME_TENC;
+	    r->npos = 0;
+	    r->state = RS_NAME;
+	    // fall through
+	case RS_NAME:
+	    if (':' == c) {
+		r->vpos = 0;
+		if (0 != (r->names & NAME_CLEN) && sizeof(clen_name) - 1 == r->npos) {
+		    r->clen = 0;
+		    r->state = RS_CLEN;
+		} else if (0 != (r->names & NAME_TENC) && sizeof(tenc_name) - 1 == r->npos) {
+		    r->state = RS_TENC;
+		} else {
+		    r->state = RS_SKIP;
+		}
+	    } else if ('\n' == c) {
+		r->state = RS_NAME_START; // not a header, ignore it
+	    } else {
+		c = lower(c);
+		if (0 != (r->names & NAME_CLEN) && (sizeof(clen_name) - 1 <= r->npos || clen_name[r->npos] != c)) {
+		    r->names &= ~NAME_CLEN;
+		}
+		if (0 != (r->names & NAME_TENC) && (sizeof(tenc_name) - 1 <= r->npos || tenc_name[r->npos] != c)) {
+		    r->names &= ~NAME_TENC;
+		}
+		if (r->npos < UINT8_MAX) {
+		    r->npos++;
+		}
+	    }
+	    break;
+	case RS_CLEN:
+	    if ('0' <= c && c <= '9') {
+		if ((LONG_MAX - 9) / 10 < r->clen) {
+		    return -1;
+		}
+		r->clen = r->clen * 10 + c - '0';
+		r->vpos = 1;
+	    } else if (' ' == c || '\t' == c) {
+		if (0 != r->vpos) {
+		    r->state = RS_CLEN_TAIL;
+		}
+	    } else if (('\r' == c || '\n' == c) && 0 != r->vpos) {
+		r->state = ('\n' == c) ? RS_NAME_START : RS_CLEN_TAIL;
+	    } else {
+		return -1;
+	    }
+	    break;
+	case RS_CLEN_TAIL:
+	    if ('\n' == c) {
+		r->state = RS_NAME_START;
+	    } else if (' ' != c && '\t' != c && '\r' != c) {
+		return -1;
+	    }
+	    break;
+	case RS_TENC:
+	    // Looks for chunked anywhere in the list of codings.
+	    if ('\n' == c) {
+		r->state = RS_NAME_START;
+	    } else if (chunked[r->vpos] == (c = lower(c))) {
+		if (sizeof(chunked) - 1 == ++r->vpos) {
+		    r->chunked = true;
+		    r->vpos = 0;
+		}
+	    } else {
+		r->vpos = (*chunked == c) ? 1 : 0;
+	    }
+	    break;
+	default:
+	    break;
+	}
+    }
+    r->off = len;
+
+    return 0;
+}
+
+// Returns the number of bytes that can be dropped without being looked at,
+// which is what is left of a Content-Length body or of the current chunk.
+long
+resp_skippable(Resp r) {
+    return (RS_BODY == r->state || RS_CHUNK_DATA == r->state) ? r->left : 0;
+}
+
+// Accounts for up to cnt bytes of body data that were dropped or skipped.
+// Returns the number of those bytes that were data.
+long
+resp_skip(Resp r, long cnt) {
+    if (r->left <= cnt) {
+	cnt = r->left;
+	if (RS_BODY == r->state) {
+	    r->done = true;
+	    r->state = RS_DONE;
+	} else {
+	    r->state = RS_CHUNK_END;
+	}
+    }
+    r->left -= cnt;
+
+    return cnt;
+}
+
+static int
+hex_val(int c) {
+    if ('0' <= c && c <= '9') {
+	return c - '0';
+    }
+    c = lower(c);
+    if ('a' <= c && c <= 'f') {
+	return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Works through body bytes that follow the headers, or follow the body bytes
+// from the last call. Nothing is kept from buf so the caller can reuse the
+// buffer for the next read. Returns the number of bytes that belong to the
+// response, which is all of len unless the response ends before that, or -1
+// if the chunk framing is malformed. The done flag is set once the end of
+// the response has been reached.
+long
+resp_body(Resp r, const char *buf, long len) {
+    const unsigned char	*start = (const unsigned char*)buf;
+    const unsigned char	*b = start;
+    const unsigned char	*end = start + len;
+    int			v;
+
+    while (b < end && !r->done) {
+	switch (r->state) {
+	case RS_BODY:
+	case RS_CHUNK_DATA:
+	    // The data itself is skipped without looking at it.
+	    b += resp_skip(r, end - b);
+	    break;
+	case RS_CHUNK_SIZE:
+	    if (0 <= (v = hex_val(*b))) {
+		if ((LONG_MAX >> 4) < r->left) {
+		    return -1;
+		}
+		r->left = (r->left << 4) + v;
+		r->vpos = 1;
+		b++;
+		break;
+	    }
+	    if (0 == r->vpos) {
+		return -1;
+	    }
+	    r->state = RS_CHUNK_EXT;
+	    // fall through
+	case RS_CHUNK_EXT:
+	    if (end == (b = find_nl(b, end))) {
+		break;
+	    }
+	    b++;
+	    r->state = (0 == r->left) ? RS_TRAILER_START : RS_CHUNK_DATA;
+	    break;
+	case RS_CHUNK_END:
+	    if ('\n' == *b) {
+		r->vpos = 0;
+		r->state = RS_CHUNK_SIZE;
+	    } else if ('\r' != *b) {
+		return -1;
+	    }
+	    b++;
+	    break;
+	case RS_TRAILER_START:
+	    if ('\n' == *b) {
+		r->done = true;
+		r->state = RS_DONE;
+	    } else if ('\r' != *b) {
+		r->state = RS_TRAILER;
+	    }
+	    b++;
+	    break;
+	case RS_TRAILER:
+	    if (end == (b = find_nl(b, end))) {
+		break;
+	    }
+	    b++;
+	    r->state = RS_TRAILER_START;
+	    break;
+	default:
+	    // Headers not complete or already done.
+	    return -1;
+	}
+    }
+    return b - start;
+}
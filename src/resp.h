@@ -0,0 +1,34 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#ifndef PERFER_RESP_H
+#define PERFER_RESP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A resumable HTTP/1.1 response header parser. Each call picks up where the
+// last one stopped so every byte is looked at once no matter how a response
+// is split across reads. Header names are matched without regard to case.
+// Bodies, chunked or not, are then framed by resp_body() without being kept.
+typedef struct _resp {
+    long	off;     // bytes of the response scanned so far
+    long	hsize;   // size of the status line and headers once complete
+    long	clen;    // Content-Length or -1 if not given
+    long	left;    // body or chunk bytes still to come
+    int		status;
+    bool	chunked;
+    bool	done;    // the whole response has been seen
+    uint8_t	state;
+    uint8_t	names;   // header names the current name still matches
+    uint8_t	npos;    // bytes of the current header name seen
+    uint8_t	vpos;    // progress through the current header value
+} *Resp;
+
+extern void	resp_init(void);
+extern void	resp_reset(Resp r);
+extern long	resp_parse(Resp r, const char *buf, long len);
+extern long	resp_body(Resp r, const char *buf, long len);
+extern long	resp_skippable(Resp r);
+extern long	resp_skip(Resp r, long cnt);
+
+#endif /* PERFER_RESP_H */
@@ -1,215 +1,281 @@
 // Copyright 2019 by Peter Ohler, All Rights Reserved
 
+#include <errno.h>
 #include <math.h>
-#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "mem.h"
 #include "stagger.h"
 
-// < 256            [ array of counts for each value ]
-// < 256 * 16       [ array of counts for each value >> 4 ]
-// < 256 * 16 * 16  [ array of counts for each value >> 8 ]
+// With sub_cnt of 2048 (3 digits):
+// < 2048            [ 2048 slots, one for each value ]
+// < 2048 * 2        [ 1024 slots, each 2 wide ]
+// < 2048 * 4        [ 1024 slots, each 4 wide ]
 // ...
+//
+// Values at or above 2^MAX_BITS nanoseconds (a bit less than 5 hours) are
+// counted in the last slot but min, max, and sum still use the real value.
+#define MAX_BITS	44
 
-#define SLOT_CNT	256
-
-typedef atomic_uint_fast64_t	Slot;
-
-typedef struct _level {
-    uint64_t	top; // top of range stored
-    uint64_t	inc; // increment between each
-    Slot	slots[SLOT_CNT];
-} *Level;
-
-typedef struct _stagger {
-    struct _level	levels[15];
-} *Stagger;
-
-static struct _stagger	bank = {
-    .levels = {
-	{ .top = 0x0000000000000100ULL, .inc = 0x0000000000000001ULL, { 0 }},
-	{ .top = 0x0000000000001000ULL, .inc = 0x0000000000000010ULL, { 0 }},
-	{ .top = 0x0000000000010000ULL, .inc = 0x0000000000000100ULL, { 0 }},
-	{ .top = 0x0000000000100000ULL, .inc = 0x0000000000001000ULL, { 0 }},
-	{ .top = 0x0000000001000000ULL, .inc = 0x0000000000010000ULL, { 0 }},
-	{ .top = 0x0000000010000000ULL, .inc = 0x0000000000100000ULL, { 0 }},
-	{ .top = 0x0000000100000000ULL, .inc = 0x0000000001000000ULL, { 0 }},
-	{ .top = 0x0000001000000000ULL, .inc = 0x0000000010000000ULL, { 0 }},
-	{ .top = 0x0000010000000000ULL, .inc = 0x0000000100000000ULL, { 0 }},
-	{ .top = 0x0000100000000000ULL, .inc = 0x0000001000000000ULL, { 0 }},
-	{ .top = 0x0001000000000000ULL, .inc = 0x0000010000000000ULL, { 0 }},
-	{ .top = 0x0010000000000000ULL, .inc = 0x0000100000000000ULL, { 0 }},
-	{ .top = 0x0100000000000000ULL, .inc = 0x0001000000000000ULL, { 0 }},
-	{ .top = 0x1000000000000000ULL, .inc = 0x0010000000000000ULL, { 0 }},
-	{ .top = 0x0000000000000000ULL, .inc = 0x0000000000000000ULL, { 0 }},
-    }
-};
+static int
+level_of(Stagger s, uint64_t val) {
+    if (val < (uint64_t)s->sub_cnt) {
+	return 0;
+    }
+    int	level = 64 - __builtin_clzll(val) - s->sub_bits;
 
-void
-stagger_init(void) {
-    for (Level level = bank.levels; 0 != level->top; level++) {
-	int	i = SLOT_CNT;
+    if (s->level_cnt <= level) {
+	level = s->level_cnt - 1;
+    }
+    return level;
+}
 
-	for (Slot *sp = level->slots; 0 < i; i--, sp++) {
-	    atomic_init(sp, 0);
-	}
+static uint64_t*
+level_slots(Stagger s, int level) {
+    if (0 == level) {
+	return s->slots;
     }
+    return s->slots + s->sub_cnt + (level - 1) * s->half_cnt;
 }
 
-void
-stagger_add(uint64_t val) {
-    for (Level level = bank.levels; 0 != level->top; level++) {
-	if (level->top > val) {
-	    atomic_fetch_add(level->slots + val / level->inc, 1);
-	    break;
-	}
+// Lowest value that would be placed in a slot of a level.
+static uint64_t
+slot_low(Stagger s, int level, int i) {
+    if (0 == level) {
+	return (uint64_t)i;
     }
+    return (uint64_t)(i + s->half_cnt) << level;
 }
 
-uint64_t
-stagger_count(void) {
-    uint64_t	cnt = 0;
+// The slots are in mapped memory that is faulted in by the thread that calls
+// stagger_init() so adding to them never faults.
+static size_t
+slots_size(Stagger s) {
+    return (s->sub_cnt + (s->level_cnt - 1) * s->half_cnt) * sizeof(uint64_t);
+}
 
-    for (Level level = bank.levels; 0 != level->top; level++) {
-	int	i = SLOT_CNT;
+int
+stagger_init(Stagger s, int digits) {
+    uint64_t	largest = 2;
 
-	for (Slot *sp = level->slots; 0 < i; i--, sp++) {
-	    cnt += atomic_load(sp);
-	}
+    memset(s, 0, sizeof(struct _stagger));
+    if (digits < STAGGER_MIN_DIGITS || STAGGER_MAX_DIGITS < digits) {
+	return EINVAL;
     }
-    return cnt;
+    for (int i = digits; 0 < i; i--) {
+	largest *= 10;
+    }
+    s->digits = digits;
+    for (s->sub_bits = 1; (1ULL << s->sub_bits) < largest; s->sub_bits++) {
+    }
+    s->sub_cnt = 1 << s->sub_bits;
+    s->half_cnt = s->sub_cnt / 2;
+    s->level_cnt = MAX_BITS - s->sub_bits + 1;
+    s->min = UINT64_MAX;
+    if (NULL == (s->level_cnts = (uint64_t*)calloc(s->level_cnt, sizeof(uint64_t))) ||
+	NULL == (s->slots = (uint64_t*)mem_alloc(slots_size(s)))) {
+	stagger_cleanup(s);
+	return ENOMEM;
+    }
+    return 0;
 }
 
-uint64_t
-stagger_at(double target) {
-    uint64_t	total = stagger_count();
-    uint64_t	tcnt = (uint64_t)(total * target);
-    uint64_t	cnt = 0;
-    uint64_t	inc;
-    uint64_t	val = 0;
-
-    for (Level level = bank.levels; 0 != level->top; level++) {
-	int	i = 0;
-
-	for (Slot *sp = level->slots; i < SLOT_CNT; i++, sp++) {
-	    inc = atomic_load(sp);
-	    if (0 < inc) {
-		cnt += inc;
-		val = level->inc * i;
-		if (tcnt == cnt) {
-		    return val;
-		} else if (tcnt < cnt) {
-		    val = level->inc * (i- 1) + (tcnt - (cnt - inc)) * level->inc / inc;
-		    return val;
-		}
-	    }
-	}
+void
+stagger_cleanup(Stagger s) {
+    free(s->level_cnts);
+    mem_free(s->slots, slots_size(s));
+    s->level_cnts = NULL;
+    s->slots = NULL;
+}
+
+void
+stagger_reset(Stagger s) {
+    memset(s->level_cnts, 0, s->level_cnt * sizeof(uint64_t));
+    memset(s->slots, 0, (s->sub_cnt + (s->level_cnt - 1) * s->half_cnt) * sizeof(uint64_t));
+    s->cnt = 0;
+    s->sum = 0;
+    s->min = UINT64_MAX;
+    s->max = 0;
+}
+
+void
+stagger_add(Stagger s, uint64_t val) {
+    int	level = level_of(s, val);
+    int	i;
+
+    if (0 == level) {
+	i = (int)val;
+    } else if (s->level_cnt - 1 == level && (uint64_t)s->sub_cnt << level <= val) {
+	i = s->half_cnt - 1;
+    } else {
+	i = (int)(val >> level) - s->half_cnt;
+    }
+    level_slots(s, level)[i]++;
+    s->level_cnts[level]++;
+    s->cnt++;
+    s->sum += val;
+    if (val < s->min) {
+	s->min = val;
+    }
+    if (s->max < val) {
+	s->max = val;
+    }
+}
+
+// Both staggers must have the same number of digits.
+void
+stagger_merge(Stagger s, Stagger other) {
+    uint64_t	*sp = s->slots;
+    uint64_t	*op = other->slots;
+    uint64_t	*end = sp + s->sub_cnt + (s->level_cnt - 1) * s->half_cnt;
+
+    if (0 == other->cnt) {
+	return;
+    }
+    for (; sp < end; sp++, op++) {
+	*sp += *op;
+    }
+    for (int i = 0; i < s->level_cnt; i++) {
+	s->level_cnts[i] += other->level_cnts[i];
+    }
+    s->cnt += other->cnt;
+    s->sum += other->sum;
+    if (other->min < s->min) {
+	s->min = other->min;
+    }
+    if (s->max < other->max) {
+	s->max = other->max;
     }
-    return val;
 }
 
 uint64_t
-stagger_range(uint64_t min, uint64_t max) {
+stagger_count(Stagger s) {
+    return s->cnt;
+}
+
+// Returns the value at the target fraction of the samples. The level totals
+// are used to find the level so only the slots of one level are walked.
+uint64_t
+stagger_at(Stagger s, double target) {
+    uint64_t	tcnt = (uint64_t)ceil((double)s->cnt * target);
     uint64_t	cnt = 0;
+    int		level;
 
-    for (Level level = bank.levels; 0 != level->top; level++) {
-	if (level->top < min) {
-	    continue;
+    if (0 == s->cnt) {
+	return 0;
+    }
+    if (tcnt < 1) {
+	tcnt = 1;
+    }
+    if (s->cnt <= tcnt) {
+	return s->max;
+    }
+    for (level = 0; level < s->level_cnt; level++) {
+	if (tcnt <= cnt + s->level_cnts[level]) {
+	    break;
 	}
-	int		i = 0;
-	uint64_t	v;
+	cnt += s->level_cnts[level];
+    }
+    uint64_t	*sp = level_slots(s, level);
+    int		scnt = (0 == level) ? s->sub_cnt : s->half_cnt;
+    uint64_t	width = (0 == level) ? 1 : 1ULL << level;
+    uint64_t	val;
 
-	for (Slot *sp = level->slots; i < SLOT_CNT; i++, sp++) {
-	    v = level->inc * i;
-	    if (max < v) {
-		return cnt;
-	    }
-	    if (min <= v) {
-		cnt += atomic_load(sp);
+    for (int i = 0; i < scnt; i++, sp++) {
+	if (0 == *sp) {
+	    continue;
+	}
+	if (tcnt <= cnt + *sp) {
+	    // Interpolate within the slot then keep it in the known range.
+	    val = slot_low(s, level, i) + (width - 1) * (tcnt - cnt) / *sp;
+	    if (val < s->min) {
+		val = s->min;
+	    } else if (s->max < val) {
+		val = s->max;
 	    }
+	    return val;
 	}
+	cnt += *sp;
     }
-    return cnt;
+    return s->max;
 }
 
-uint64_t
-stagger_average(void) {
+// Number of samples less than val.
+static uint64_t
+count_below(Stagger s, uint64_t val) {
     uint64_t	cnt = 0;
-    double	sum = 0.0;
-    uint64_t	scnt;
+    int		top = level_of(s, val);
 
-    for (Level level = bank.levels; 0 != level->top; level++) {
-	int	i = 0;
+    for (int level = 0; level < top; level++) {
+	cnt += s->level_cnts[level];
+    }
+    uint64_t	*sp = level_slots(s, top);
+    int		scnt = (0 == top) ? s->sub_cnt : s->half_cnt;
 
-	for (Slot *sp = level->slots; i < SLOT_CNT; i++, sp++) {
-	    scnt = atomic_load(sp);
-	    if (0 < scnt) {
-		cnt += scnt;
-		sum += (double)(level->inc * i) * (double)scnt;
-	    }
-	}
+    for (int i = 0; i < scnt && slot_low(s, top, i) < val; i++, sp++) {
+	cnt += *sp;
     }
-    if (0 == cnt) {
+    return cnt;
+}
+
+// Number of samples from min up to but not including max.
+uint64_t
+stagger_range(Stagger s, uint64_t min, uint64_t max) {
+    if (max <= min) {
 	return 0;
     }
-    return (uint64_t)(sum / (double)cnt);
+    return count_below(s, max) - count_below(s, min);
 }
 
 uint64_t
-stagger_min(void) {
-    for (Level level = bank.levels; 0 != level->top; level++) {
-	int		i = 0;
-	uint64_t	scnt;
-
-	for (Slot *sp = level->slots; i < SLOT_CNT; i++, sp++) {
-	    if (0 < (scnt = atomic_load(sp))) {
-		return level->inc * i;
-	    }
-	}
+stagger_average(Stagger s) {
+    if (0 == s->cnt) {
+	return 0;
     }
-    return 0;
+    return s->sum / s->cnt;
 }
 
 uint64_t
-stagger_max(void) {
-    uint64_t	last = 0;
-
-    for (Level level = bank.levels; 0 != level->top; level++) {
-	int		i = 0;
-	uint64_t	scnt;
-
-	for (Slot *sp = level->slots; i < SLOT_CNT; i++, sp++) {
-	    if (0 < (scnt = atomic_load(sp))) {
-		last = level->inc * i;
-	    }
-	}
+stagger_min(Stagger s) {
+    if (0 == s->cnt) {
+	return 0;
     }
-    return last;
+    return s->min;
 }
 
-// Standard Deviation in nanoseconds.
+uint64_t
+stagger_max(Stagger s) {
+    return s->max;
+}
+
+// Standard Deviation in nanoseconds around the exact mean using the middle
+// of each slot.
 double
-stagger_stddev(void) {
-    uint64_t	cnt = 0;
+stagger_stddev(Stagger s) {
+    double	mean;
     double	sum = 0.0;
-    uint64_t	scnt;
-    int64_t	mean = (int64_t)stagger_at(0.5);
     double	diff;
 
-    for (Level level = bank.levels; 0 != level->top; level++) {
-	int	i = 0;
+    if (s->cnt <= 1) {
+	return 0.0;
+    }
+    mean = (double)s->sum / (double)s->cnt;
+    for (int level = 0; level < s->level_cnt; level++) {
+	if (0 == s->level_cnts[level]) {
+	    continue;
+	}
+	uint64_t	*sp = level_slots(s, level);
+	int		scnt = (0 == level) ? s->sub_cnt : s->half_cnt;
+	double		half = (0 == level) ? 0.0 : (double)(1ULL << level) / 2.0;
 
-	for (Slot *sp = level->slots; i < SLOT_CNT; i++, sp++) {
-	    scnt = atomic_load(sp);
-	    if (0 < scnt) {
-		cnt += scnt;
-		diff = (double)((int64_t)(level->inc * i) - mean);
-		sum += diff * diff * scnt;
+	for (int i = 0; i < scnt; i++, sp++) {
+	    if (0 < *sp) {
+		diff = (double)slot_low(s, level, i) + half - mean;
+		sum += diff * diff * (double)*sp;
 	    }
 	}
     }
-    if (cnt <= 1) {
-	return 0.0;
-    }
-    return sqrt(sum / (double)(cnt - 1));
+    return sqrt(sum / (double)(s->cnt - 1));
 }
@@ -5,16 +5,43 @@
 
 #include <stdint.h>
 
-extern void	stagger_init(void);
-extern void	stagger_add(uint64_t val);
+#define STAGGER_MIN_DIGITS	1
+#define STAGGER_MAX_DIGITS	4
+
+// A stagger is a histogram with a configurable number of significant
+// digits. Values below the sub slot count are stored exactly. Above that each
+// level doubles the range and the width of a slot so the relative error never
+// exceeds the precision requested. Count, min, max, and sum are exact.
+//
+// A stagger is written by a single thread so no atomics are used. Each pool
+// has its own and they are merged once the run has completed.
+typedef struct _stagger {
+    int		digits;
+    int		sub_bits;  // log2 of sub_cnt
+    int		sub_cnt;   // slots in the first level
+    int		half_cnt;  // slots in each of the other levels
+    int		level_cnt;
+    uint64_t	cnt;
+    uint64_t	sum;
+    uint64_t	min;
+    uint64_t	max;
+    uint64_t	*level_cnts; // total for each level
+    uint64_t	*slots;
+} *Stagger;
+
+extern int	stagger_init(Stagger s, int digits);
+extern void	stagger_cleanup(Stagger s);
+extern void	stagger_reset(Stagger s);
+extern void	stagger_add(Stagger s, uint64_t val);
+extern void	stagger_merge(Stagger s, Stagger other);
 
 // Analysis functions.
-extern uint64_t	stagger_count(void);
-extern uint64_t	stagger_at(double target);
-extern uint64_t	stagger_range(uint64_t min, uint64_t max);
-extern uint64_t	stagger_average(void);
-extern uint64_t	stagger_min(void);
-extern uint64_t	stagger_max(void);
-extern double	stagger_stddev(void);
+extern uint64_t	stagger_count(Stagger s);
+extern uint64_t	stagger_at(Stagger s, double target);
+extern uint64_t	stagger_range(Stagger s, uint64_t min, uint64_t max);
+extern uint64_t	stagger_average(Stagger s);
+extern uint64_t	stagger_min(Stagger s);
+extern uint64_t	stagger_max(Stagger s);
+extern double	stagger_stddev(Stagger s);
 
 #endif /* PERFER_STAGGER_H */
@@ -0,0 +1,349 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#ifdef HAVE_URING
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+static int
+uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+uring_enter(int fd, unsigned submit, unsigned wait_nr, unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait_nr, flags, arg, argsz);
+}
+
+static int
+uring_register(int fd, unsigned op, void *arg, unsigned nargs) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nargs);
+}
+
+static int
+init_buf_ring(Uring u, unsigned buf_cnt, unsigned buf_size) {
+    struct io_uring_buf_reg	reg;
+
+    u->buf_cnt = buf_cnt;
+    u->buf_size = buf_size;
+    u->br_size = buf_cnt * sizeof(struct io_uring_buf);
+    if (MAP_FAILED == (u->br = mmap(NULL, u->br_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0))) {
+	u->br = NULL;
+	return errno;
+    }
+    if (NULL == (u->bufs = (char*)malloc((size_t)buf_cnt * buf_size))) {
+	return ENOMEM;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = buf_cnt;
+    reg.bgid = URING_BGID;
+    if (0 > uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1)) {
+	return errno;
+    }
+    u->br_tail = 0;
+    for (unsigned i = 0; i < buf_cnt; i++) {
+	uring_buf_return(u, i);
+    }
+    return 0;
+}
+
+// Sets up a ring with at least entries submission slots and buf_cnt provided
+// buffers of buf_size bytes each. The buffer count must be a power of 2 no
+// larger than 32768. Returns 0 or an errno value.
+int
+uring_init(Uring u, unsigned entries, unsigned buf_cnt, unsigned buf_size) {
+    struct io_uring_params	params;
+    unsigned			flags[] = {
+	// Completions are only run when waiting which avoids interrupting
+	// the thread while it is sending.
+	IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+	IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL,
+	IORING_SETUP_CQSIZE,
+	0,
+    };
+    unsigned	*array;
+
+    memset(u, 0, sizeof(struct _uring));
+    u->fd = -1;
+    for (unsigned *fp = flags; fp < flags + sizeof(flags) / sizeof(*flags); fp++) {
+	memset(&params, 0, sizeof(params));
+	params.flags = *fp;
+	params.cq_entries = entries * 4; // multishot receives post many completions
+	if (0 <= (u->fd = uring_setup(entries, &params)) || EINVAL != errno) {
+	    break;
+	}
+    }
+    if (0 > u->fd) {
+	return errno;
+    }
+    u->sq_entries = params.sq_entries;
+    u->cq_entries = params.cq_entries;
+    u->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    u->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (0 != (params.features & IORING_FEAT_SINGLE_MMAP)) {
+	if (u->sq_ring_size < u->cq_ring_size) {
+	    u->sq_ring_size = u->cq_ring_size;
+	}
+	u->cq_ring_size = 0;
+    }
+    if (MAP_FAILED == (u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING))) {
+	u->sq_ring = NULL;
+	return errno;
+    }
+    if (0 == u->cq_ring_size) {
+	u->cq_ring = u->sq_ring;
+    } else if (MAP_FAILED == (u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING))) {
+	u->cq_ring = NULL;
+	return errno;
+    }
+    u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (MAP_FAILED == (u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES))) {
+	u->sqes = NULL;
+	return errno;
+    }
+    u->sq_head = (unsigned*)((char*)u->sq_ring + params.sq_off.head);
+    u->sq_tail = (unsigned*)((char*)u->sq_ring + params.sq_off.tail);
+    u->sq_mask = (unsigned*)((char*)u->sq_ring + params.sq_off.ring_mask);
+    u->sq_array = (unsigned*)((char*)u->sq_ring + params.sq_off.array);
+    u->cq_head = (unsigned*)((char*)u->cq_ring + params.cq_off.head);
+    u->cq_tail = (unsigned*)((char*)u->cq_ring + params.cq_off.tail);
+    u->cq_mask = (unsigned*)((char*)u->cq_ring + params.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)((char*)u->cq_ring + params.cq_off.cqes);
+
+    // Slots are always used in order so the index array never changes.
+    array = u->sq_array;
+    for (unsigned i = 0; i < u->sq_entries; i++) {
+	array[i] = i;
+    }
+    u->sq_local = *u->sq_tail;
+
+    return init_buf_ring(u, buf_cnt, buf_size);
+}
+
+void
+uring_cleanup(Uring u) {
+    if (0 <= u->fd) {
+	close(u->fd);
+	u->fd = -1;
+    }
+    if (NULL != u->sqes) {
+	munmap(u->sqes, u->sqes_size);
+	u->sqes = NULL;
+    }
+    if (NULL != u->cq_ring && u->cq_ring != u->sq_ring) {
+	munmap(u->cq_ring, u->cq_ring_size);
+    }
+    u->cq_ring = NULL;
+    if (NULL != u->sq_ring) {
+	munmap(u->sq_ring, u->sq_ring_size);
+	u->sq_ring = NULL;
+    }
+    if (NULL != u->br) {
+	munmap(u->br, u->br_size);
+	u->br = NULL;
+    }
+    free(u->bufs);
+    u->bufs = NULL;
+}
+
+// Registers the request body as fixed buffer 0 so the kernel does not have to
+// map the pages for every send. Not all kernels accept a fixed buffer with a
+// plain send so one byte is sent over a socket pair to check. If either step
+// fails sends fall back to the normal copy.
+void
+uring_register_send(Uring u, const char *buf, size_t len) {
+    struct iovec	iov = { .iov_base = (void*)buf, .iov_len = len };
+    struct io_uring_cqe	*cqe;
+    int			sp[2];
+
+    u->fixed = false;
+    if (0 != uring_register(u->fd, IORING_REGISTER_BUFFERS, &iov, 1)) {
+	return;
+    }
+    if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, sp)) {
+	return;
+    }
+    u->fixed = true;
+    uring_send(u, sp[0], buf, 1, 0);
+    u->fixed = false;
+    if (0 == uring_submit_wait(u, 1000) && NULL != (cqe = uring_peek(u))) {
+	u->fixed = (1 == cqe->res);
+	uring_seen(u);
+    }
+    close(sp[0]);
+    close(sp[1]);
+    if (!u->fixed) {
+	uring_register(u->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    }
+}
+
+// Checks that the kernel has what the loop depends on, a provided buffer ring
+// and multishot receives, which came in Linux 5.19 and 6.0. A multishot
+// receive is armed on a socket pair and the byte written to it must come back
+// with the receive still armed.
+bool
+uring_probe(void) {
+    struct _uring	u;
+    struct io_uring_cqe	*cqe;
+    int			sp[2];
+    bool		ok = false;
+
+    if (0 == uring_init(&u, 8, 8, 64) && 0 == socketpair(AF_UNIX, SOCK_STREAM, 0, sp)) {
+	uring_recv_multishot(&u, sp[1], 1);
+	if (1 == write(sp[0], "x", 1) && 0 == uring_submit_wait(&u, 1000) && NULL != (cqe = uring_peek(&u))) {
+	    ok = (1 == cqe->res && 0 != (cqe->flags & IORING_CQE_F_MORE));
+	    uring_seen(&u);
+	}
+	uring_cleanup(&u);
+	close(sp[0]);
+	close(sp[1]);
+    } else {
+	uring_cleanup(&u);
+    }
+    return ok;
+}
+
+static int
+submit(Uring u, unsigned wait_nr, unsigned flags, void *arg, size_t argsz) {
+    int	cnt;
+
+    __atomic_store_n(u->sq_tail, u->sq_local, __ATOMIC_RELEASE);
+    if (0 > (cnt = uring_enter(u->fd, u->pending, wait_nr, flags, arg, argsz))) {
+	if (ETIME == errno || EINTR == errno) {
+	    return 0;
+	}
+	return -errno;
+    }
+    if ((unsigned)cnt < u->pending) {
+	u->pending -= cnt;
+    } else {
+	u->pending = 0;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe*
+get_sqe(Uring u) {
+    struct io_uring_sqe	*sqe;
+
+    while (u->sq_entries <= u->sq_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE)) {
+	// Full so hand what is queued to the kernel to make room.
+	if (0 != submit(u, 0, 0, NULL, 0)) {
+	    break;
+	}
+    }
+    sqe = u->sqes + (u->sq_local & *u->sq_mask);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    u->sq_local++;
+    u->pending++;
+
+    return sqe;
+}
+
+void
+uring_send(Uring u, int fd, const char *buf, size_t len, uint64_t user_data) {
+    struct io_uring_sqe	*sqe = get_sqe(u);
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL; // short sends are finished by the kernel
+    sqe->user_data = user_data;
+    if (u->fixed) {
+	sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+	sqe->buf_index = 0;
+    }
+}
+
+void
+uring_recv_multishot(Uring u, int fd, uint64_t user_data) {
+    struct io_uring_sqe	*sqe = get_sqe(u);
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = user_data;
+}
+
+// A one shot poll, used to learn when a non-blocking connect finishes.
+void
+uring_poll_add(Uring u, int fd, unsigned events, uint64_t user_data) {
+    struct io_uring_sqe	*sqe = get_sqe(u);
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+}
+
+// Submits everything queued and waits up to timeout_ms for a completion
+// unless one is already waiting. A negative timeout waits forever. Returns 0
+// or a negative errno value.
+int
+uring_submit_wait(Uring u, int timeout_ms) {
+    struct __kernel_timespec		ts;
+    struct io_uring_getevents_arg	arg;
+    unsigned				wait_nr = 1;
+
+    if (__atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) != *u->cq_head) {
+	wait_nr = 0;
+    }
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (0 <= timeout_ms) {
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL;
+	arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    return submit(u, wait_nr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+// Returns the next completion or NULL if there are none. Call uring_seen()
+// once done with it.
+struct io_uring_cqe*
+uring_peek(Uring u) {
+    unsigned	head = *u->cq_head;
+
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+	return NULL;
+    }
+    return u->cqes + (head & *u->cq_mask);
+}
+
+void
+uring_seen(Uring u) {
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+char*
+uring_buf(Uring u, unsigned id) {
+    return u->bufs + (size_t)id * u->buf_size;
+}
+
+// Gives a provided buffer back to the kernel.
+void
+uring_buf_return(Uring u, unsigned id) {
+    struct io_uring_buf	*b = u->br->bufs + (u->br_tail & (u->buf_cnt - 1));
+
+    b->addr = (uint64_t)(uintptr_t)uring_buf(u, id);
+    b->len = u->buf_size;
+    b->bid = (uint16_t)id;
+    u->br_tail++;
+    __atomic_store_n(&u->br->tail, (uint16_t)u->br_tail, __ATOMIC_RELEASE);
+}
+
+#endif /* HAVE_URING */
@@ -0,0 +1,66 @@
+// Copyright 2019 by Peter Ohler, All Rights Reserved
+
+#ifndef PERFER_URING_H
+#define PERFER_URING_H
+
+#ifdef HAVE_URING
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+// A minimal io_uring wrapper that talks to the kernel with the raw system
+// calls so liburing is not needed. It is only used by the thread that
+// created it.
+typedef struct _uring {
+    int				fd;
+    unsigned			sq_entries;
+    unsigned			cq_entries;
+    unsigned			*sq_head;
+    unsigned			*sq_tail;
+    unsigned			*sq_mask;
+    unsigned			*sq_array;
+    unsigned			sq_local; // tail of the entries not yet published
+    unsigned			pending;  // entries published but not submitted
+    struct io_uring_sqe		*sqes;
+    unsigned			*cq_head;
+    unsigned			*cq_tail;
+    unsigned			*cq_mask;
+    struct io_uring_cqe		*cqes;
+    void			*sq_ring;
+    size_t			sq_ring_size;
+    void			*cq_ring;
+    size_t			cq_ring_size;
+    size_t			sqes_size;
+
+    // Provided buffer ring for multishot receives.
+    struct io_uring_buf_ring	*br;
+    size_t			br_size;
+    char			*bufs;
+    unsigned			buf_cnt;
+    unsigned			buf_size;
+    unsigned			br_tail;
+    bool			fixed; // send buffer registered as index 0
+} *Uring;
+
+// Buffer group used for the provided buffer ring.
+#define URING_BGID	1
+
+extern int			uring_init(Uring u, unsigned entries, unsigned buf_cnt, unsigned buf_size);
+extern void			uring_cleanup(Uring u);
+extern void			uring_register_send(Uring u, const char *buf, size_t len);
+extern bool			uring_probe(void);
+
+extern void			uring_send(Uring u, int fd, const char *buf, size_t len, uint64_t user_data);
+extern void			uring_recv_multishot(Uring u, int fd, uint64_t user_data);
+extern void			uring_poll_add(Uring u, int fd, unsigned events, uint64_t user_data);
+extern int			uring_submit_wait(Uring u, int timeout_ms);
+
+extern struct io_uring_cqe*	uring_peek(Uring u);
+extern void			uring_seen(Uring u);
+extern char*			uring_buf(Uring u, unsigned id);
+extern void			uring_buf_return(Uring u, unsigned id);
+
+#endif /* HAVE_URING */
+#endif /* PERFER_URING_H */